@@ -0,0 +1,111 @@
+#include "EchoClient.h"
+#include "TCPClient/TCPClient.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+/**
+* Writes the next message once the echo of the previous one is read, through the handlers of net::tcp::Client.
+* The allocations are counted on the thread of the client, at the start and at the end of the measured round trips.
+*/
+class EchoClient : public net::tcp::Client
+{
+public:
+
+    EchoClient(const net::SocketOptions& socketOptions, std::size_t messageSize, uint32_t numWarmUps, uint32_t numRoundTrips)
+        : Client(socketOptions)
+        , m_Message(messageSize, 'm')
+        , m_NumWarmUps(numWarmUps)
+        , m_NumRoundTrips(numRoundTrips)
+    {
+    }
+
+    bool OnConnected() override
+    {
+        AsyncRead();
+        WriteMessage();
+        return true;
+    }
+
+    void OnConnectionError(const std::string& errorMessage) override
+    {
+        printf("\nCould not connect : %s", errorMessage.c_str());
+        m_IsDone = true;
+    }
+
+    bool OnDataReceived(const std::shared_ptr<const std::vector<uint8_t>>&, std::size_t bytesRead) override
+    {
+        // the echo of a message may arrive in more than one read.
+        m_BytesEchoed += bytesRead;
+        if (m_BytesEchoed < m_Message.size())
+            return true;
+
+        m_BytesEchoed = 0;
+        ++m_NumRoundTripsDone;
+
+        if (m_NumRoundTripsDone == m_NumWarmUps)
+            m_AllocationsBefore = NumAllocations;
+
+        if (m_NumRoundTripsDone == m_NumWarmUps + m_NumRoundTrips)
+        {
+            m_NumAllocations = NumAllocations - m_AllocationsBefore;
+            m_IsDone = true;
+            return true;
+        }
+
+        WriteMessage();
+        return true;
+    }
+
+    /**
+    * Returns true once the round trips are done, or the client could not connect.
+    */
+    bool IsDone() const { return m_IsDone; }
+
+    /**
+    * Returns the number of allocations during the measured round trips, valid once IsDone() is true.
+    */
+    uint64_t GetNumAllocations() const { return m_NumAllocations; }
+
+private:
+
+    /**
+    * Writes the message with a completion callback, so the std::function of the write handler is measured as well.
+    */
+    void WriteMessage()
+    {
+        AsyncWrite(m_Message, m_Message.size(), [](std::size_t) { return true; });
+    }
+
+private:
+
+    const std::vector<uint8_t>  m_Message;
+    const uint32_t              m_NumWarmUps;
+    const uint32_t              m_NumRoundTrips;
+
+    std::size_t                 m_BytesEchoed = 0;
+    uint32_t                    m_NumRoundTripsDone = 0;
+    uint64_t                    m_AllocationsBefore = 0;
+    uint64_t                    m_NumAllocations = 0;
+    std::atomic<bool>           m_IsDone = false;
+};
+
+uint64_t RunClientEcho(uint16_t port, std::size_t messageSize, uint32_t numWarmUps, uint32_t numRoundTrips,
+    const std::function<void()>& stopServer)
+{
+    net::SocketOptions socketOptions;
+    socketOptions.NoDelay = true;
+
+    EchoClient client(socketOptions, messageSize, numWarmUps, numRoundTrips);
+    client.AsyncConnect("127.0.0.1", port);
+
+    while (!client.IsDone())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // the client has no way to close its socket, the pending read ends once the server closes the connection.
+    stopServer();
+    client.Wait();
+
+    return client.GetNumAllocations();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/*
+* Allocations of the process, counted by the replacement of the global operator new in Source.cpp.
+* The client side lives in its own translation unit, as TCPClient.h and Server.h declare callback types of the same name.
+*/
+extern std::atomic<uint64_t> NumAllocations;
+
+/**
+* Runs echo round trips against the server on the given port through net::tcp::Client, and counts the allocations
+* of the steady state, on the thread of the client.
+*
+* @param [in] stopServer
+*       Called once the round trips are done, the client waits till the server closes the connection.
+*
+* @return
+*       Number of allocations during the measured round trips.
+*/
+uint64_t RunClientEcho(uint16_t port, std::size_t messageSize, uint32_t numWarmUps, uint32_t numRoundTrips,
+    const std::function<void()>& stopServer);
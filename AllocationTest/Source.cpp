@@ -0,0 +1,176 @@
+#include "TCPServer/Server.h"
+#include "TCPServer/ClientHandler.h"
+#include "EchoClient.h"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <vector>
+
+/*
+* Counts every allocation of the process through the global operator new.
+* Checks that the steady state read/write path of a client does not allocate, e.g. that no handler is stored in a
+* std::function or a vector is rebuilt on every read and write. asio takes the memory of its operations from its own
+* per-thread caches, which do not go through operator new.
+*/
+std::atomic<uint64_t> NumAllocations = 0;
+
+void* operator new(std::size_t size)
+{
+    ++NumAllocations;
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++NumAllocations;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+// GCC pairs the inlined replacements up with the allocations of the standard library and warns about free().
+#if defined(__GNUC__)
+    #pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+
+/* Size of the messages that are echoed. */
+static constexpr std::size_t MessageSize = 64;
+
+/**
+* Echoes every chunk back with a payload that was made up front, so the server itself does not allocate.
+*/
+class EchoServer : public net::tcp::Server
+{
+public:
+
+    explicit EchoServer(const net::tcp::ServerConfig& config)
+        : Server(config)
+    {
+        for (std::size_t size = 1; size <= MessageSize; ++size)
+            m_Replies.push_back(net::SharedPayload::Create(std::vector<uint8_t>(size, 'e')));
+    }
+
+    bool OnClientConnected(net::tcp::ClientID) override { return true; }
+
+    void OnDataReceived(net::tcp::ClientHandler& client, std::span<const uint8_t> data) override
+    {
+        client.ScheduleWrite(m_Replies[data.size() - 1]);
+    }
+
+private:
+
+    /* Reply for every size of chunk that can be read. */
+    std::vector<net::SharedPayload> m_Replies;
+};
+
+/**
+* Runs echo round trips over the loopback interface and counts the allocations of the steady state.
+*
+* @return
+*       Number of allocations per round trip after the warm up.
+*/
+static double CountAllocationsPerRoundTrip(const char* name, net::tcp::ServerConfig config, uint32_t numWarmUps, uint32_t numRoundTrips)
+{
+    EchoServer server(config);
+    server.Start();
+
+    boost::asio::io_context ioContext;
+    boost::asio::ip::tcp::socket socket(ioContext);
+    socket.connect({ boost::asio::ip::make_address("127.0.0.1"), static_cast<uint16_t>(config.Port) });
+    socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+    uint8_t message[MessageSize] = {};
+    uint8_t echo[MessageSize];
+
+    auto roundTrip = [&]()
+    {
+        boost::asio::write(socket, boost::asio::buffer(message));
+        boost::asio::read(socket, boost::asio::buffer(echo));
+    };
+
+    // the first round trips fill the caches of the recycling allocator and size the buffers.
+    for (uint32_t i = 0; i < numWarmUps; ++i)
+        roundTrip();
+
+    uint64_t allocationsBefore = NumAllocations;
+    for (uint32_t i = 0; i < numRoundTrips; ++i)
+        roundTrip();
+    uint64_t numAllocations = NumAllocations - allocationsBefore;
+
+    socket.close();
+    server.Stop();
+
+    double perRoundTrip = static_cast<double>(numAllocations) / numRoundTrips;
+    printf("\n%s : %llu allocations in %u round trips, %.3f per round trip\n", name,
+        static_cast<unsigned long long>(numAllocations), numRoundTrips, perRoundTrip);
+
+    return perRoundTrip;
+}
+
+/**
+* Runs the echo round trips through net::tcp::Client instead of a raw socket, so the handlers and the read buffer of
+* the client are counted as well as the ones of the server.
+*
+* @return
+*       Number of allocations per round trip after the warm up.
+*/
+static double CountClientAllocationsPerRoundTrip(const char* name, net::tcp::ServerConfig config, uint32_t numWarmUps, uint32_t numRoundTrips)
+{
+    std::optional<EchoServer> server(std::in_place, config);
+    server->Start();
+
+    // destroying the server closes the connection, which ends the pending read of the client.
+    uint64_t numAllocations = RunClientEcho(static_cast<uint16_t>(config.Port), MessageSize, numWarmUps, numRoundTrips,
+        [&server]() { server.reset(); });
+
+    double perRoundTrip = static_cast<double>(numAllocations) / numRoundTrips;
+    printf("\n%s : %llu allocations in %u round trips, %.3f per round trip\n", name,
+        static_cast<unsigned long long>(numAllocations), numRoundTrips, perRoundTrip);
+
+    return perRoundTrip;
+}
+
+int main()
+{
+    bool isPassed = true;
+
+    net::tcp::ServerConfig config;
+    config.Port = 42300;
+    isPassed &= CountAllocationsPerRoundTrip("Read/write", config, 1000, 10000) == 0;
+
+    config.Port = 42301;
+    config.NumThreads = 2;
+    isPassed &= CountAllocationsPerRoundTrip("Read/write, 2 threads", config, 1000, 10000) == 0;
+
+    // the payloads of every batch are held till the kernel completes them, in vectors that are reused.
+    config.Port = 42302;
+    config.NumThreads = 1;
+    config.ZeroCopyThreshold = 1;
+    isPassed &= CountAllocationsPerRoundTrip("Zero-copy writes", config, 1000, 10000) == 0;
+
+    config.Port = 42303;
+    config.ZeroCopyThreshold = 0;
+    isPassed &= CountClientAllocationsPerRoundTrip("net::tcp::Client read/write", config, 1000, 10000) == 0;
+
+    printf("\n%s\n", isPassed ? "PASSED" : "FAILED");
+    return isPassed ? 0 : 1;
+}
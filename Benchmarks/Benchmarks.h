@@ -0,0 +1,89 @@
+#pragma once
+
+#include "TCPServer/Server.h"
+#include "TCPServer/ClientHandler.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+/**
+* A benchmark gets the command line arguments that follow its name, and returns the exit code of the process.
+*/
+using BenchmarkFunction = int(*)(int argc, char** argv);
+
+/* Loopback echo throughput of the server, from 1 to N threads. */
+int RunEchoBenchmark(int argc, char** argv);
+
+/* Fan-out of a broadcast to N clients, with one shared payload vs a copy per client. */
+int RunBroadcastBenchmark(int argc, char** argv);
+
+/* CRLF scan of the SIMD DelimiterScanner vs std::search and memchr. */
+int RunDelimiterBenchmark(int argc, char** argv);
+
+/* Memory per idle connection with each read buffer mode. */
+int RunIdleMemoryBenchmark(int argc, char** argv);
+
+/* File send with sendfile()/TransmitFile() vs reading the file into the process, from 1 MB to 1 GB. */
+int RunFileBenchmark(int argc, char** argv);
+
+/* Writes with MSG_ZEROCOPY vs copying writes, CPU per GB and the message size from which zero-copy pays off. */
+int RunZeroCopyBenchmark(int argc, char** argv);
+
+/**
+* Returns the command line argument at 'index' as a number, or 'defaultValue' if it is not given.
+*/
+inline uint64_t GetArgument(int argc, char** argv, int index, uint64_t defaultValue)
+{
+    return index < argc ? std::strtoull(argv[index], nullptr, 10) : defaultValue;
+}
+
+/**
+* Returns the seconds that passed since 'start'.
+*/
+inline double GetSecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+* Connects a blocking socket to a server on the loopback interface.
+*/
+inline boost::asio::ip::tcp::socket ConnectToLoopback(boost::asio::io_context& ioContext, uint16_t port)
+{
+    boost::asio::ip::tcp::socket socket(ioContext);
+    socket.connect({ boost::asio::ip::make_address("127.0.0.1"), port });
+    socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    return socket;
+}
+
+/**
+* Returns the CPU time that all the threads of the process spent so far, in user and kernel mode, in seconds.
+*/
+inline double GetProcessCPUSeconds()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+
+    auto toSeconds = [](const FILETIME& time)
+    {
+        return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return toSeconds(kernel) + toSeconds(user);
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
@@ -0,0 +1,213 @@
+#include "Benchmarks.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+using namespace net::tcp;
+
+namespace
+{
+
+/**
+* Sends every message to all of its clients, either as one shared payload or as a copy per client.
+*/
+class BroadcastServer : public Server
+{
+public:
+
+    explicit BroadcastServer(const ServerConfig& config)
+        : Server(config)
+    {
+    }
+
+    bool OnClientConnected(ClientID ID) override
+    {
+        std::scoped_lock lock(m_Mutex);
+        m_ClientIDs.push_back(ID);
+        return true;
+    }
+
+    void OnDataReceived(ClientHandler&, std::span<const uint8_t>) override {}
+
+    /**
+    * Sends the message to all the clients.
+    *
+    * @param [in] isShared
+    *       True to send one payload that all the clients share, false to copy the message for every client.
+    */
+    void Broadcast(const std::vector<uint8_t>& message, bool isShared)
+    {
+        if (isShared)
+        {
+            MessageAllClients(net::SharedPayload::Copy(message.data(), message.size()));
+            return;
+        }
+
+        std::scoped_lock lock(m_Mutex);
+        for (ClientID ID : m_ClientIDs)
+        {
+            if (ClientHandlerSPtr client = GetClient(ID))
+                client->ScheduleWrite(net::SharedPayload::Copy(message.data(), message.size()));
+        }
+    }
+
+private:
+
+    std::mutex              m_Mutex;
+    std::vector<ClientID>   m_ClientIDs;
+};
+
+/**
+* Received messages and the latency of their delivery, of one client.
+*/
+struct ReceiverResult
+{
+    std::atomic<uint64_t>   NumReceived = 0;
+    double                  TotalLatency = 0;
+    double                  MaxLatency = 0;
+};
+
+/**
+* Returns the time that is stamped into the messages, in nanoseconds.
+*/
+uint64_t GetTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Reads 'numMessages' messages and measures how long each one took from the broadcast to here.
+*/
+void RunReceiver(boost::asio::ip::tcp::socket socket, std::size_t messageSize, uint64_t numMessages, ReceiverResult& result)
+{
+    try
+    {
+        std::vector<uint8_t> message(messageSize);
+        for (uint64_t i = 0; i < numMessages; ++i)
+        {
+            boost::asio::read(socket, boost::asio::buffer(message));
+
+            uint64_t sentAt = 0;
+            std::memcpy(&sentAt, message.data(), sizeof(sentAt));
+            double latency = (GetTimestamp() - sentAt) / 1000.0;
+
+            result.TotalLatency += latency;
+            result.MaxLatency = std::max(result.MaxLatency, latency);
+            ++result.NumReceived;
+        }
+    }
+    catch (std::exception& e)
+    {
+        printf("\nBroadcast receiver failed : %s", e.what());
+    }
+}
+
+/**
+* Results of one run of the broadcast.
+*/
+struct BroadcastResult
+{
+    double      Seconds = 0;
+    uint64_t    BytesCopied = 0;
+    double      AverageLatency = 0;
+    double      MaxLatency = 0;
+};
+
+/**
+* Broadcasts 'numMessages' messages to 'numClients' clients, with at most 'window' messages in flight to the slowest client.
+*/
+BroadcastResult RunBroadcast(bool isShared, uint32_t numClients, uint64_t numMessages, std::size_t messageSize, uint64_t window)
+{
+    ServerConfig config;
+    config.Port = isShared ? 42100 : 42101;
+
+    BroadcastServer server(config);
+    server.Start();
+
+    boost::asio::io_context ioContext;
+    std::vector<std::unique_ptr<ReceiverResult>> results;
+    std::vector<std::thread> receivers;
+
+    for (uint32_t i = 0; i < numClients; ++i)
+    {
+        results.push_back(std::make_unique<ReceiverResult>());
+        receivers.emplace_back(RunReceiver, ConnectToLoopback(ioContext, static_cast<uint16_t>(config.Port)),
+            messageSize, numMessages, std::ref(*results.back()));
+    }
+
+    while (server.GetNumClients() < numClients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    auto getSlowestReceived = [&]()
+    {
+        uint64_t slowest = numMessages;
+        for (const auto& result : results)
+            slowest = std::min<uint64_t>(slowest, result->NumReceived);
+        return slowest;
+    };
+
+    std::vector<uint8_t> message(messageSize, 'b');
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < numMessages; ++i)
+    {
+        // the window keeps the queues short, so the latency is that of the fan-out and not of a backlog.
+        while (i - getSlowestReceived() >= window)
+            std::this_thread::yield();
+
+        uint64_t sentAt = GetTimestamp();
+        std::memcpy(message.data(), &sentAt, sizeof(sentAt));
+        server.Broadcast(message, isShared);
+    }
+
+    for (std::thread& receiver : receivers)
+        receiver.join();
+
+    BroadcastResult result;
+    result.Seconds = GetSecondsSince(start);
+    result.BytesCopied = numMessages * messageSize * (isShared ? 1 : numClients);
+
+    for (const auto& receiverResult : results)
+    {
+        result.AverageLatency += receiverResult->TotalLatency;
+        result.MaxLatency = std::max(result.MaxLatency, receiverResult->MaxLatency);
+    }
+    result.AverageLatency /= static_cast<double>(numMessages * numClients);
+
+    server.Stop();
+    return result;
+}
+
+}
+
+/**
+* Compares a broadcast that shares one payload between all the clients with one that copies the message for every client.
+* Reports the bytes that are copied into payloads, the throughput and the latency from the broadcast to the receivers.
+*/
+int RunBroadcastBenchmark(int argc, char** argv)
+{
+    uint32_t numClients = static_cast<uint32_t>(GetArgument(argc, argv, 0, 64));
+    uint64_t numMessages = GetArgument(argc, argv, 1, 20000);
+    std::size_t messageSize = static_cast<std::size_t>(std::max<uint64_t>(GetArgument(argc, argv, 2, 1024), sizeof(uint64_t)));
+    uint64_t window = std::max<uint64_t>(GetArgument(argc, argv, 3, 16), 1);
+
+    BroadcastResult shared = RunBroadcast(true, numClients, numMessages, messageSize, window);
+    BroadcastResult copied = RunBroadcast(false, numClients, numMessages, messageSize, window);
+
+    printf("\n\nBroadcast, %u clients, %llu messages of %zu bytes, window of %llu messages\n", numClients,
+        static_cast<unsigned long long>(numMessages), messageSize, static_cast<unsigned long long>(window));
+    printf("%-16s %12s %14s %14s %14s\n", "payload", "MB copied", "messages/s", "avg latency us", "max latency us");
+
+    auto printResult = [&](const char* name, const BroadcastResult& result)
+    {
+        printf("%-16s %12.1f %14.0f %14.1f %14.1f\n", name, result.BytesCopied / (1024.0 * 1024.0),
+            numMessages / result.Seconds, result.AverageLatency, result.MaxLatency);
+    };
+
+    printResult("shared", shared);
+    printResult("copy per client", copied);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "Benchmarks.h"
+#include "TCPCommon/DelimiterScanner.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+using namespace net;
+
+namespace
+{
+
+const uint8_t Delimiter[] = { '\r', '\n' };
+
+/**
+* Lengths of the lines of one kind of traffic.
+*/
+struct LineDistribution
+{
+    const char*     Name;
+    std::size_t     MinLength;
+    std::size_t     MaxLength;
+};
+
+const LineDistribution AllDistributions[] =
+{
+    { "chat 8-64 B",        8,      64 },
+    { "log 80-300 B",       80,     300 },
+    { "json 1-4 KB",        1024,   4 * 1024 },
+    { "bulk 16-64 KB",      16 * 1024, 64 * 1024 },
+};
+
+/**
+* Fills about 'size' bytes with printable lines of the given lengths, each one ended by CRLF.
+*/
+std::vector<uint8_t> MakeLines(const LineDistribution& distribution, std::size_t size)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<std::size_t> lengths(distribution.MinLength, distribution.MaxLength);
+    std::uniform_int_distribution<int> characters(' ', '~');
+
+    std::vector<uint8_t> lines;
+    lines.reserve(size + distribution.MaxLength + sizeof(Delimiter));
+
+    while (lines.size() < size)
+    {
+        std::size_t length = lengths(random);
+        for (std::size_t i = 0; i < length; ++i)
+            lines.push_back(static_cast<uint8_t>(characters(random)));
+
+        lines.insert(lines.end(), std::begin(Delimiter), std::end(Delimiter));
+    }
+
+    return lines;
+}
+
+/**
+* Finds every line in 'lines' with 'find' over and over for 'seconds'.
+*
+* @return
+*       Bytes scanned per second.
+*/
+template <typename Find>
+double MeasureScan(const std::vector<uint8_t>& lines, double seconds, Find find)
+{
+    uint64_t bytesScanned = 0;
+    std::size_t numLines = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (GetSecondsSince(start) < seconds)
+    {
+        std::size_t offset = 0;
+        while (offset < lines.size())
+        {
+            std::size_t found = find(lines.data() + offset, lines.size() - offset);
+            if (found == DelimiterScanner::npos)
+                break;
+
+            offset += found + sizeof(Delimiter);
+            ++numLines;
+        }
+
+        bytesScanned += lines.size();
+    }
+
+    // every line is found, or the implementations are not compared on the same work.
+    if (numLines == 0)
+        printf("\nNo line was found");
+
+    return bytesScanned / GetSecondsSince(start);
+}
+
+}
+
+/**
+* Compares the SIMD DelimiterScanner with std::search and a memchr based scan, on lines of realistic lengths.
+*/
+int RunDelimiterBenchmark(int argc, char** argv)
+{
+    std::size_t bufferSize = static_cast<std::size_t>(GetArgument(argc, argv, 0, 1024 * 1024));
+    double seconds = static_cast<double>(GetArgument(argc, argv, 1, 1));
+
+    DelimiterScanner scanner(Delimiter);
+
+    auto findScanner = [&](const uint8_t* data, std::size_t size)
+    {
+        return scanner.Find({ data, size });
+    };
+
+    auto findSearch = [](const uint8_t* data, std::size_t size)
+    {
+        const uint8_t* found = std::search(data, data + size, std::begin(Delimiter), std::end(Delimiter));
+        return found == data + size ? DelimiterScanner::npos : static_cast<std::size_t>(found - data);
+    };
+
+    auto findMemchr = [](const uint8_t* data, std::size_t size)
+    {
+        const uint8_t* end = data + size;
+        for (const uint8_t* at = data; at + sizeof(Delimiter) <= end; ++at)
+        {
+            at = static_cast<const uint8_t*>(std::memchr(at, Delimiter[0], end - at - 1));
+            if (!at)
+                break;
+
+            if (at[1] == Delimiter[1])
+                return static_cast<std::size_t>(at - data);
+        }
+        return DelimiterScanner::npos;
+    };
+
+    printf("\nCRLF scan of %zu byte buffers, %s DelimiterScanner\n", bufferSize, DelimiterScanner::GetImplementationName());
+    printf("%-16s %14s %14s %14s %10s\n", "lines", "scanner MB/s", "search MB/s", "memchr MB/s", "vs best");
+
+    for (const LineDistribution& distribution : AllDistributions)
+    {
+        std::vector<uint8_t> lines = MakeLines(distribution, bufferSize);
+
+        double scannerRate = MeasureScan(lines, seconds, findScanner);
+        double searchRate = MeasureScan(lines, seconds, findSearch);
+        double memchrRate = MeasureScan(lines, seconds, findMemchr);
+
+        printf("%-16s %14.0f %14.0f %14.0f %9.2fx\n", distribution.Name, scannerRate / (1024 * 1024),
+            searchRate / (1024 * 1024), memchrRate / (1024 * 1024), scannerRate / std::max(searchRate, memchrRate));
+    }
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "Benchmarks.h"
+#include <atomic>
+
+using namespace net::tcp;
+
+namespace
+{
+
+/**
+* Writes every chunk that it receives back to the client.
+*/
+class EchoServer : public Server
+{
+public:
+
+    explicit EchoServer(const ServerConfig& config)
+        : Server(config)
+    {
+    }
+
+    bool OnClientConnected(ClientID) override { return true; }
+
+    void OnDataReceived(ClientHandler& client, std::span<const uint8_t> data) override
+    {
+        client.ScheduleWrite(net::SharedPayload::Copy(data.data(), data.size()));
+    }
+};
+
+/**
+* Sends a message and waits for its echo, over and over till 'deadline'.
+*
+* @return
+*       Number of bytes that were echoed.
+*/
+uint64_t RunEchoClient(uint16_t port, std::size_t messageSize, std::chrono::steady_clock::time_point deadline)
+{
+    uint64_t bytesEchoed = 0;
+
+    try
+    {
+        boost::asio::io_context ioContext;
+        boost::asio::ip::tcp::socket socket = ConnectToLoopback(ioContext, port);
+
+        std::vector<uint8_t> message(messageSize, 'e');
+        std::vector<uint8_t> echo(messageSize);
+
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            boost::asio::write(socket, boost::asio::buffer(message));
+            boost::asio::read(socket, boost::asio::buffer(echo));
+            bytesEchoed += messageSize;
+        }
+    }
+    catch (std::exception& e)
+    {
+        printf("\nEcho client failed : %s", e.what());
+    }
+
+    return bytesEchoed;
+}
+
+}
+
+/**
+* Measures the echo throughput of the server on the loopback interface with 1, 2, 4, ... up to 'maxThreads' threads.
+* Every client runs on its own thread and keeps one message in flight, so with enough clients the server is the bottleneck.
+*/
+int RunEchoBenchmark(int argc, char** argv)
+{
+    uint32_t maxThreads = static_cast<uint32_t>(GetArgument(argc, argv, 0, std::max(1u, std::thread::hardware_concurrency())));
+    uint32_t numClients = static_cast<uint32_t>(GetArgument(argc, argv, 1, 64));
+    uint32_t seconds = static_cast<uint32_t>(GetArgument(argc, argv, 2, 3));
+    std::size_t messageSize = static_cast<std::size_t>(GetArgument(argc, argv, 3, 4096));
+
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+        threadCounts.push_back(numThreads);
+    threadCounts.push_back(maxThreads);
+
+    // the server logs every connection, so the results are printed together at the end.
+    std::vector<double> bytesPerSecond;
+
+    for (uint32_t numThreads : threadCounts)
+    {
+        ServerConfig config;
+        config.Port = 42000 + static_cast<int>(numThreads);
+        config.NumThreads = numThreads;
+
+        EchoServer server(config);
+        server.Start();
+
+        std::atomic<uint64_t> totalBytes = 0;
+        std::vector<std::thread> clients;
+
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::seconds(seconds);
+
+        for (uint32_t i = 0; i < numClients; ++i)
+        {
+            clients.emplace_back([&]()
+                {
+                    totalBytes += RunEchoClient(static_cast<uint16_t>(config.Port), messageSize, deadline);
+                });
+        }
+
+        for (std::thread& client : clients)
+            client.join();
+
+        double elapsed = GetSecondsSince(start);
+        server.Stop();
+
+        bytesPerSecond.push_back(totalBytes / elapsed);
+    }
+
+    printf("\n\nEcho, %u clients, %zu byte messages, %u s per run\n", numClients, messageSize, seconds);
+    printf("%8s %12s %14s %10s\n", "threads", "MB/s", "round trips/s", "speedup");
+    for (std::size_t i = 0; i < threadCounts.size(); ++i)
+    {
+        printf("%8u %12.1f %14.0f %9.2fx\n", threadCounts[i], bytesPerSecond[i] / (1024 * 1024),
+            bytesPerSecond[i] / messageSize, bytesPerSecond[i] / bytesPerSecond[0]);
+    }
+
+    return 0;
+}
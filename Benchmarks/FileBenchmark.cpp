@@ -0,0 +1,172 @@
+#include "Benchmarks.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+
+using namespace net::tcp;
+
+namespace
+{
+
+/* Size of the chunks that the file is read in when it is copied through the process. */
+constexpr std::size_t ReadChunkSize = 1024 * 1024;
+
+/**
+* Sends a file to its only client, either with Server::SendFile() or by reading it into payloads that are written.
+*/
+class FileServer : public Server
+{
+public:
+
+    explicit FileServer(const ServerConfig& config)
+        : Server(config)
+    {
+    }
+
+    bool OnClientConnected(ClientID ID) override
+    {
+        m_ClientID = ID;
+        return true;
+    }
+
+    void OnDataReceived(ClientHandler&, std::span<const uint8_t>) override {}
+
+    /**
+    * Sends the file to the client.
+    *
+    * @param [in] isSendFile
+    *       True to send the file from the kernel, false to read it into the process and write it.
+    *
+    * @return
+    *       False, if the file could not be sent.
+    */
+    bool Send(const std::string& path, uint64_t size, bool isSendFile)
+    {
+        if (isSendFile)
+            return SendFile(m_ClientID, path);
+
+        std::ifstream file(path, std::ios::binary);
+        for (uint64_t offset = 0; offset < size; offset += ReadChunkSize)
+        {
+            std::vector<uint8_t> chunk(static_cast<std::size_t>(std::min<uint64_t>(ReadChunkSize, size - offset)));
+            if (!file.read(reinterpret_cast<char*>(chunk.data()), chunk.size()))
+                return false;
+
+            MessageClient(m_ClientID, net::SharedPayload::Create(std::move(chunk)));
+        }
+
+        return true;
+    }
+
+private:
+
+    std::atomic<ClientID>   m_ClientID = 0;
+};
+
+/**
+* Throughput and CPU time of sending one size of file.
+*/
+struct FileResult
+{
+    double      Seconds = 0;
+    double      CPUSeconds = 0;
+};
+
+/**
+* Sends the file 'numSends' times to a client on the loopback interface, that reads it all.
+*/
+FileResult MeasureFileSend(const std::string& path, uint64_t size, uint32_t numSends, bool isSendFile)
+{
+    ServerConfig config;
+    config.Port = isSendFile ? 42400 : 42401;
+
+    FileServer server(config);
+    server.Start();
+
+    boost::asio::io_context ioContext;
+    boost::asio::ip::tcp::socket socket = ConnectToLoopback(ioContext, static_cast<uint16_t>(config.Port));
+
+    while (server.GetNumClients() < 1)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    std::vector<uint8_t> buffer(ReadChunkSize);
+    FileResult result;
+    double startCPU = GetProcessCPUSeconds();
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < numSends; ++i)
+    {
+        if (!server.Send(path, size, isSendFile))
+        {
+            printf("\nCould not send %s", path.c_str());
+            break;
+        }
+
+        for (uint64_t received = 0; received < size; )
+            received += socket.read_some(boost::asio::buffer(buffer));
+    }
+
+    result.Seconds = GetSecondsSince(start);
+    result.CPUSeconds = GetProcessCPUSeconds() - startCPU;
+
+    socket.close();
+    server.Stop();
+    return result;
+}
+
+}
+
+/**
+* Compares sending files with Server::SendFile() against reading them into the process and writing the payloads,
+* from 1 MB up to 'maxSizeMB'. The files are read once before they are measured, so both come from the page cache.
+* The CPU time is that of the whole process, the client that reads the files is included and costs the same in both.
+*/
+int RunFileBenchmark(int argc, char** argv)
+{
+    uint64_t maxSize = GetArgument(argc, argv, 0, 1024) * 1024 * 1024;
+    uint64_t bytesPerSize = GetArgument(argc, argv, 1, 1024) * 1024 * 1024;
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "benchmark_file.bin";
+
+    struct SizeResult
+    {
+        uint64_t    Size;
+        double      Gigabytes;
+        FileResult  SendFile;
+        FileResult  Copied;
+    };
+    std::vector<SizeResult> results;
+
+    for (uint64_t size = 1024 * 1024; size <= maxSize; size *= 4)
+    {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            std::vector<char> chunk(ReadChunkSize, 'f');
+            for (uint64_t written = 0; written < size; written += chunk.size())
+                file.write(chunk.data(), chunk.size());
+        }
+
+        uint32_t numSends = static_cast<uint32_t>(std::max<uint64_t>(bytesPerSize / size, 1));
+        double gigabytes = static_cast<double>(size) * numSends / (1024.0 * 1024.0 * 1024.0);
+
+        // a first send brings the file into the page cache.
+        MeasureFileSend(path.string(), size, 1, false);
+        FileResult sendFile = MeasureFileSend(path.string(), size, numSends, true);
+        FileResult copied = MeasureFileSend(path.string(), size, numSends, false);
+        results.push_back({ size, gigabytes, sendFile, copied });
+    }
+
+    printf("\n\nFile send over the loopback interface\n");
+    printf("%-10s %14s %14s %18s %18s\n", "file", "sendfile MB/s", "copy MB/s", "sendfile CPU s/GB", "copy CPU s/GB");
+
+    for (const SizeResult& result : results)
+    {
+        printf("%-7llu MB %14.0f %14.0f %18.3f %18.3f\n", static_cast<unsigned long long>(result.Size / (1024 * 1024)),
+            result.Gigabytes * 1024 / result.SendFile.Seconds, result.Gigabytes * 1024 / result.Copied.Seconds,
+            result.SendFile.CPUSeconds / result.Gigabytes, result.Copied.CPUSeconds / result.Gigabytes);
+    }
+
+    std::filesystem::remove(path);
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "Benchmarks.h"
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#if defined(_WIN32)
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <unistd.h>
+#endif
+
+using namespace net::tcp;
+
+namespace
+{
+
+/**
+* Accepts every client and ignores what they send.
+*/
+class IdleServer : public Server
+{
+public:
+
+    explicit IdleServer(const ServerConfig& config)
+        : Server(config)
+    {
+    }
+
+    bool OnClientConnected(ClientID) override { return true; }
+
+    void OnDataReceived(ClientHandler&, std::span<const uint8_t>) override {}
+};
+
+/**
+* Memory of the process in bytes.
+*/
+struct ProcessMemory
+{
+    /* Memory that is mapped or committed, whether it was touched or not. */
+    uint64_t    Virtual = 0;
+
+    /* Memory that is resident. */
+    uint64_t    Resident = 0;
+};
+
+ProcessMemory GetProcessMemory()
+{
+    ProcessMemory memory;
+
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+    {
+        memory.Virtual = counters.PrivateUsage;
+        memory.Resident = counters.WorkingSetSize;
+    }
+#else
+    // the first two fields of statm are the size of the mappings and the resident set, in pages.
+    std::ifstream statm("/proc/self/statm");
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    statm >> memory.Virtual >> memory.Resident;
+    memory.Virtual *= pageSize;
+    memory.Resident *= pageSize;
+#endif
+
+    return memory;
+}
+
+/**
+* Read buffer setup that is measured.
+*/
+struct ReadBufferMode
+{
+    const char*     Name;
+    void            (*Apply)(ServerConfig& config);
+};
+
+const ReadBufferMode AllModes[] =
+{
+    { "adaptive", [](ServerConfig&) {} },
+    { "fixed", [](ServerConfig& config) { config.ReadBufferMinSize = config.ReadBufferInitialSize = config.ReadBufferMaxSize; } },
+    { "shared", [](ServerConfig& config) { config.UseSharedReadBuffers = true; } },
+    { "mirrored", [](ServerConfig& config)
+        {
+            config.Framing.Mode = net::FramingMode::LengthPrefixed;
+            config.UseMirroredReadBuffer = true;
+        } },
+};
+
+/**
+* Memory per connection of one read buffer mode.
+*/
+struct IdleMemoryResult
+{
+    double      Virtual = 0;
+    double      Resident = 0;
+    double      ReadBuffer = 0;
+};
+
+/**
+* Connects 'numClients' clients that stay idle, and measures how much the memory of the process grew per connection.
+*/
+IdleMemoryResult MeasureIdleConnections(const ReadBufferMode& mode, int port, uint32_t numClients)
+{
+    ServerConfig config;
+    config.Port = port;
+    mode.Apply(config);
+
+    IdleServer server(config);
+    server.Start();
+
+    boost::asio::io_context ioContext;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> clients;
+    clients.reserve(numClients);
+
+    ProcessMemory before = GetProcessMemory();
+
+    for (uint32_t i = 0; i < numClients; ++i)
+        clients.push_back(std::make_unique<boost::asio::ip::tcp::socket>(ConnectToLoopback(ioContext, static_cast<uint16_t>(port))));
+
+    while (server.GetNumClients() < numClients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // lets the clients arm their first read.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    ProcessMemory after = GetProcessMemory();
+
+    IdleMemoryResult result;
+    result.Virtual = (static_cast<double>(after.Virtual) - static_cast<double>(before.Virtual)) / numClients;
+    result.Resident = (static_cast<double>(after.Resident) - static_cast<double>(before.Resident)) / numClients;
+    result.ReadBuffer = static_cast<double>(server.GetStats().GetReadBufferBytes()) / numClients;
+
+    clients.clear();
+    server.Stop();
+    return result;
+}
+
+}
+
+/**
+* Measures the memory that an idle connection costs with one read buffer mode.
+* Run every mode in its own process, memory that an earlier run freed would be reused and hide the cost.
+* The clients run in the same process, their sockets are included, but they hold no buffers of their own.
+*/
+int RunIdleMemoryBenchmark(int argc, char** argv)
+{
+    uint32_t numClients = static_cast<uint32_t>(GetArgument(argc, argv, 0, 2000));
+    const char* modeName = argc > 1 ? argv[1] : AllModes[0].Name;
+
+    for (const ReadBufferMode& mode : AllModes)
+    {
+        if (std::strcmp(mode.Name, modeName) != 0)
+            continue;
+
+        IdleMemoryResult result = MeasureIdleConnections(mode, 42200, numClients);
+
+        printf("\n\nMemory per idle connection, %u connections\n", numClients);
+        printf("%-12s %14s %14s %16s\n", "read buffer", "virtual KB", "resident KB", "read buffer KB");
+        printf("%-12s %14.2f %14.2f %16.2f\n", mode.Name, result.Virtual / 1024, result.Resident / 1024, result.ReadBuffer / 1024);
+        return 0;
+    }
+
+    printf("Unknown read buffer mode %s, the modes are:", modeName);
+    for (const ReadBufferMode& mode : AllModes)
+        printf(" %s", mode.Name);
+    printf("\n");
+
+    return 1;
+}
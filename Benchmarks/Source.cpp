@@ -0,0 +1,40 @@
+#include "Benchmarks.h"
+#include <cstring>
+
+/**
+* A benchmark that can be run from the command line.
+*/
+struct Benchmark
+{
+    const char*         Name;
+    const char*         Arguments;
+    BenchmarkFunction   Run;
+};
+
+static const Benchmark AllBenchmarks[] =
+{
+    { "echo", "[maxThreads] [numClients] [seconds] [messageSize]", RunEchoBenchmark },
+    { "broadcast", "[numClients] [numMessages] [messageSize] [window]", RunBroadcastBenchmark },
+    { "delimiter", "[bufferSize] [seconds]", RunDelimiterBenchmark },
+    { "idlememory", "[numClients] [adaptive|fixed|shared|mirrored]", RunIdleMemoryBenchmark },
+    { "file", "[maxSizeMB] [MBPerSize]", RunFileBenchmark },
+    { "zerocopy", "[numClients] [MBPerClient] [maxMessageKB]", RunZeroCopyBenchmark },
+};
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2)
+    {
+        for (const Benchmark& benchmark : AllBenchmarks)
+        {
+            if (std::strcmp(argv[1], benchmark.Name) == 0)
+                return benchmark.Run(argc - 2, argv + 2);
+        }
+    }
+
+    printf("Usage: Benchmarks <name> [arguments]\n");
+    for (const Benchmark& benchmark : AllBenchmarks)
+        printf("    %s %s\n", benchmark.Name, benchmark.Arguments);
+
+    return 1;
+}
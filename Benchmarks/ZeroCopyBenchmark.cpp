@@ -0,0 +1,169 @@
+#include "Benchmarks.h"
+#include <algorithm>
+#include <memory>
+
+using namespace net::tcp;
+
+namespace
+{
+
+/* Queued bytes at which the sender waits, and at which it goes on, so the queues stay short. */
+constexpr uint64_t MaxQueuedBytes = 64 * 1024 * 1024;
+constexpr uint64_t ResumeQueuedBytes = 16 * 1024 * 1024;
+
+/**
+* Accepts every client and ignores what they send.
+*/
+class StreamServer : public Server
+{
+public:
+
+    explicit StreamServer(const ServerConfig& config)
+        : Server(config)
+    {
+    }
+
+    bool OnClientConnected(ClientID) override { return true; }
+
+    void OnDataReceived(ClientHandler&, std::span<const uint8_t>) override {}
+};
+
+/**
+* Throughput, CPU time and zero-copy completions of one size of message.
+*/
+struct ZeroCopyResult
+{
+    double      Seconds = 0;
+    double      CPUSeconds = 0;
+    uint64_t    NumCompletions = 0;
+    uint64_t    NumCopiedCompletions = 0;
+};
+
+/**
+* Reads 'numBytes' bytes and drops them.
+*/
+void RunReader(boost::asio::ip::tcp::socket socket, uint64_t numBytes)
+{
+    try
+    {
+        std::vector<uint8_t> buffer(1024 * 1024);
+        for (uint64_t received = 0; received < numBytes; )
+            received += socket.read_some(boost::asio::buffer(buffer));
+    }
+    catch (std::exception& e)
+    {
+        printf("\nZero-copy reader failed : %s", e.what());
+    }
+}
+
+/**
+* Streams 'bytesPerClient' bytes in messages of 'messageSize' bytes to every one of 'numClients' clients.
+*/
+ZeroCopyResult MeasureStream(bool isZeroCopy, uint32_t numClients, uint64_t bytesPerClient, std::size_t messageSize)
+{
+    ServerConfig config;
+    config.Port = isZeroCopy ? 42500 : 42501;
+    config.ZeroCopyThreshold = isZeroCopy ? 1 : 0;
+
+    // the queued bytes that pace the sender are only counted with a limit or a watermark, this one is never reached.
+    config.OutboundHighWatermark = 2 * MaxQueuedBytes;
+
+    StreamServer server(config);
+    server.Start();
+
+    uint64_t numMessages = std::max<uint64_t>(bytesPerClient / messageSize, 1);
+
+    boost::asio::io_context ioContext;
+    std::vector<std::thread> readers;
+    for (uint32_t i = 0; i < numClients; ++i)
+        readers.emplace_back(RunReader, ConnectToLoopback(ioContext, static_cast<uint16_t>(config.Port)), numMessages * messageSize);
+
+    while (server.GetNumClients() < numClients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    net::SharedPayload message = net::SharedPayload::Create(std::vector<uint8_t>(messageSize, 'z'));
+
+    ZeroCopyResult result;
+    double startCPU = GetProcessCPUSeconds();
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < numMessages; ++i)
+    {
+        server.MessageAllClients(message);
+
+        if (server.GetStats().GetOutboundQueuedBytes() > MaxQueuedBytes)
+        {
+            while (server.GetStats().GetOutboundQueuedBytes() > ResumeQueuedBytes)
+                std::this_thread::yield();
+        }
+    }
+
+    for (std::thread& reader : readers)
+        reader.join();
+
+    result.Seconds = GetSecondsSince(start);
+    result.CPUSeconds = GetProcessCPUSeconds() - startCPU;
+    result.NumCompletions = server.GetStats().GetZeroCopyCompletions();
+    result.NumCopiedCompletions = server.GetStats().GetZeroCopyCopiedCompletions();
+
+    server.Stop();
+    return result;
+}
+
+}
+
+/**
+* Compares writes with MSG_ZEROCOPY against copying writes, for messages from 1 KB up to 'maxMessageKB', and reports the
+* smallest size from which zero-copy costs less CPU per GB, the value to give ServerConfig::ZeroCopyThreshold.
+* The CPU time is that of the whole process, the readers are included and cost the same in both.
+* Over the loopback interface the kernel copies every zero-copy send anyway, the "copied" column shows it, so the
+* crossover is only meaningful when the clients connect over a real network device.
+*/
+int RunZeroCopyBenchmark(int argc, char** argv)
+{
+    uint32_t numClients = static_cast<uint32_t>(GetArgument(argc, argv, 0, 4));
+    uint64_t bytesPerClient = GetArgument(argc, argv, 1, 256) * 1024 * 1024;
+    std::size_t maxMessageSize = static_cast<std::size_t>(GetArgument(argc, argv, 2, 1024)) * 1024;
+
+    struct SizeResult
+    {
+        std::size_t     MessageSize;
+        ZeroCopyResult  ZeroCopy;
+        ZeroCopyResult  Copied;
+    };
+    std::vector<SizeResult> results;
+
+    for (std::size_t messageSize = 1024; messageSize <= maxMessageSize; messageSize *= 4)
+    {
+        ZeroCopyResult zeroCopy = MeasureStream(true, numClients, bytesPerClient, messageSize);
+        ZeroCopyResult copied = MeasureStream(false, numClients, bytesPerClient, messageSize);
+        results.push_back({ messageSize, zeroCopy, copied });
+    }
+
+    double gigabytes = static_cast<double>(bytesPerClient) * numClients / (1024.0 * 1024.0 * 1024.0);
+
+    printf("\n\nZero-copy writes, %u clients, %llu MB per client\n", numClients, static_cast<unsigned long long>(bytesPerClient / (1024 * 1024)));
+    printf("%-10s %14s %14s %18s %18s %10s\n", "message", "zerocopy MB/s", "copy MB/s", "zerocopy CPU s/GB", "copy CPU s/GB", "copied %");
+
+    const SizeResult* crossover = nullptr;
+    for (const SizeResult& result : results)
+    {
+        double zeroCopyCPU = result.ZeroCopy.CPUSeconds / gigabytes;
+        double copiedCPU = result.Copied.CPUSeconds / gigabytes;
+        double copiedPercent = result.ZeroCopy.NumCompletions
+            ? 100.0 * result.ZeroCopy.NumCopiedCompletions / result.ZeroCopy.NumCompletions : 0;
+
+        printf("%-7zu KB %14.0f %14.0f %18.3f %18.3f %9.1f%%\n", result.MessageSize / 1024,
+            gigabytes * 1024 / result.ZeroCopy.Seconds, gigabytes * 1024 / result.Copied.Seconds, zeroCopyCPU, copiedCPU, copiedPercent);
+
+        if (!crossover && zeroCopyCPU < copiedCPU)
+            crossover = &result;
+    }
+
+    if (crossover)
+        printf("\nZero-copy costs less CPU from %zu KB messages on\n", crossover->MessageSize / 1024);
+    else
+        printf("\nZero-copy did not cost less CPU at any size\n");
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "TCPServer/Server.h"
+#include "TCPServer/ClientHandler.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace net;
+using namespace net::tcp;
+
+/* Number of clients, spread over the shards of the server. */
+static constexpr std::size_t NumClients = 4;
+
+/* Number of broadcasts, every one is followed by a message to every client. */
+static constexpr std::size_t NumRounds = 2000;
+
+/**
+* Keeps the IDs of its clients, so that the test can message every one of them.
+*/
+class OrderServer : public Server
+{
+public:
+
+    explicit OrderServer(const ServerConfig& config)
+        : Server(config)
+    {
+    }
+
+    bool OnClientConnected(ClientID ID) override
+    {
+        std::scoped_lock lock(m_Mutex);
+        m_ClientIDs.push_back(ID);
+        return true;
+    }
+
+    void OnDataReceived(ClientHandler&, std::span<const uint8_t>) override {}
+
+    /**
+    * Returns the IDs of the clients that are connected so far.
+    */
+    std::vector<ClientID> GetClientIDs()
+    {
+        std::scoped_lock lock(m_Mutex);
+        return m_ClientIDs;
+    }
+
+private:
+
+    std::mutex              m_Mutex;
+    std::vector<ClientID>   m_ClientIDs;
+};
+
+/**
+* Checks that a broadcast is written to every client before the messages that the same thread sends to the client
+* after it. Every round broadcasts 'A' and then sends 'B' to every client, so every client must read "ABAB...".
+*/
+static bool CheckBroadcastOrder(const char* name, ServerConfig config)
+{
+    OrderServer server(config);
+    server.Start();
+
+    boost::asio::io_context ioContext;
+    std::vector<boost::asio::ip::tcp::socket> sockets;
+    for (std::size_t i = 0; i < NumClients; ++i)
+    {
+        sockets.emplace_back(ioContext);
+        sockets.back().connect({ boost::asio::ip::make_address("127.0.0.1"), static_cast<uint16_t>(config.Port) });
+    }
+
+    while (server.GetClientIDs().size() < NumClients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    SharedPayload broadcast = SharedPayload::Copy(reinterpret_cast<const uint8_t*>("A"), 1);
+    SharedPayload direct = SharedPayload::Copy(reinterpret_cast<const uint8_t*>("B"), 1);
+
+    std::vector<ClientID> clientIDs = server.GetClientIDs();
+    for (std::size_t round = 0; round < NumRounds; ++round)
+    {
+        server.MessageAllClients(broadcast);
+        for (ClientID ID : clientIDs)
+            server.MessageClient(ID, direct);
+    }
+
+    std::size_t numOutOfOrder = 0;
+    for (boost::asio::ip::tcp::socket& socket : sockets)
+    {
+        std::vector<char> received(2 * NumRounds);
+        boost::asio::read(socket, boost::asio::buffer(received));
+
+        for (std::size_t i = 0; i < received.size(); ++i)
+        {
+            if (received[i] != (i % 2 ? 'B' : 'A'))
+                ++numOutOfOrder;
+        }
+
+        socket.close();
+    }
+
+    server.Stop();
+
+    bool isPassed = numOutOfOrder == 0;
+    printf("\n%-40s : %s (%zu of %zu bytes out of order)", name, isPassed ? "ok" : "FAILED", numOutOfOrder, 2 * NumRounds * NumClients);
+    return isPassed;
+}
+
+int main()
+{
+    bool isPassed = true;
+
+    ServerConfig config;
+    config.Port = 42310;
+    isPassed &= CheckBroadcastOrder("Broadcast order", config);
+
+    config.Port = 42311;
+    config.NumShards = 2;
+    config.NumThreads = 2;
+    isPassed &= CheckBroadcastOrder("Broadcast order, 2 shards of 2 threads", config);
+
+    printf("\n\n%s\n", isPassed ? "PASSED" : "FAILED");
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+#include "TCPServer/OutboundQueue.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace net;
+using namespace net::tcp;
+
+/* Size of every message of the checks. */
+static constexpr std::size_t MessageSize = 10;
+
+/* File that the checks queue, only its position in the queue matters. */
+static std::string FilePath;
+
+/**
+* Returns a message of MessageSize bytes that starts with 'name', so the order of the written messages can be read back.
+*/
+static SharedPayload MakeMessage(char name)
+{
+    return SharedPayload::Create(std::vector<uint8_t>(MessageSize, static_cast<uint8_t>(name)));
+}
+
+/**
+* Takes everything out of the queue like the writes of a client do, and returns the names of the messages in the
+* order they would be written, 'F' for a file.
+*/
+static std::string Drain(OutboundQueue& queue)
+{
+    std::string order;
+    while (!queue.IsEmpty())
+    {
+        if (queue.IsFileNext())
+        {
+            queue.PopFile();
+            order += 'F';
+            continue;
+        }
+
+        for (const boost::asio::const_buffer& buffer : queue.PrepareBatch())
+            order += static_cast<char>(*static_cast<const uint8_t*>(buffer.data()));
+        queue.CompleteBatch();
+    }
+    return order;
+}
+
+/**
+* Like Drain(), but ends every batch and file with '|', so the batches can be compared as well.
+*/
+static std::string DrainBatches(OutboundQueue& queue)
+{
+    std::string order;
+    while (!queue.IsEmpty())
+    {
+        if (queue.IsFileNext())
+        {
+            queue.PopFile();
+            order += "F|";
+            continue;
+        }
+
+        for (const boost::asio::const_buffer& buffer : queue.PrepareBatch())
+            order += static_cast<char>(*static_cast<const uint8_t*>(buffer.data()));
+        queue.CompleteBatch();
+        order += '|';
+    }
+    return order;
+}
+
+/**
+* Compares the written order with the expected one and reports the check.
+*/
+static bool Check(const char* name, const std::string& order, const std::string& expected)
+{
+    bool isPassed = order == expected;
+    printf("\n%-48s : %s (%s, expected %s)", name, isPassed ? "ok" : "FAILED", order.c_str(), expected.c_str());
+    return isPassed;
+}
+
+/**
+* The kept message moves into the slot of a dropped conflated message, whose key must not find the kept message.
+*/
+static bool CheckKeepMovesOverConflated()
+{
+    OutboundQueue queue;
+    queue.PushConflated(MakeMessage('a'), 1);
+    queue.PushConflated(MakeMessage('b'), 2);
+    queue.PushConflated(MakeMessage('c'), 3);
+
+    queue.DropOldest(2 * MessageSize, 1);
+
+    bool isPassed = true;
+    isPassed &= Check("dropped keys do not find the kept message", std::to_string(queue.GetConflatedSize(2) + queue.GetConflatedSize(3)), "0");
+    isPassed &= Check("kept key still finds its message", std::to_string(queue.GetConflatedSize(1)), std::to_string(MessageSize));
+
+    queue.PushConflated(MakeMessage('B'), 2);
+    queue.PushConflated(MakeMessage('C'), 3);
+    queue.PushConflated(MakeMessage('A'), 1);
+    isPassed &= Check("updates after a drop that keeps a key", Drain(queue), "ABC");
+    return isPassed;
+}
+
+/**
+* The kept message is the last one that the drop reaches, so it stays where it is.
+*/
+static bool CheckKeepInPlace()
+{
+    OutboundQueue queue;
+    queue.Push(MakeMessage('x'));
+    queue.PushConflated(MakeMessage('a'), 1);
+    queue.PushConflated(MakeMessage('b'), 2);
+
+    queue.DropOldest(MessageSize, 1);
+    queue.PushConflated(MakeMessage('A'), 1);
+    queue.PushConflated(MakeMessage('B'), 2);
+    return Check("kept message that is not moved", Drain(queue), "AB");
+}
+
+/**
+* A file queued after the kept message is still written after it, one queued before it still before it.
+*/
+static bool CheckKeepBeforeFile()
+{
+    OutboundQueue queue;
+    queue.PushConflated(MakeMessage('a'), 1);
+    queue.PushFile(FileTransfer::Open(FilePath, 0, 1, nullptr));
+    queue.Push(MakeMessage('x'));
+    queue.Push(MakeMessage('y'));
+    queue.Push(MakeMessage('z'));
+
+    queue.DropOldest(2 * MessageSize, 1);
+    queue.PushConflated(MakeMessage('A'), 1);
+
+    bool isPassed = Check("file queued after the kept message", Drain(queue), "AFz");
+
+    queue.Push(MakeMessage('x'));
+    queue.PushFile(FileTransfer::Open(FilePath, 0, 1, nullptr));
+    queue.PushConflated(MakeMessage('a'), 1);
+    queue.Push(MakeMessage('y'));
+
+    queue.DropOldest(MessageSize, 1);
+    isPassed &= Check("file queued before the kept message", Drain(queue), "Fay");
+    return isPassed;
+}
+
+/**
+* Drops without a kept key still drop the oldest messages whole.
+*/
+static bool CheckDropWithoutKeep()
+{
+    OutboundQueue queue;
+    queue.PushConflated(MakeMessage('a'), 1);
+    queue.Push(MakeMessage('x'));
+    queue.PushConflated(MakeMessage('b'), 2);
+
+    queue.DropOldest(MessageSize + 1);
+    queue.PushConflated(MakeMessage('A'), 1);
+    queue.PushConflated(MakeMessage('B'), 2);
+    bool isPassed = Check("drop without a kept key", Drain(queue), "BA");
+
+    // like a stuck consumer, every message that is queued beyond the limit drops the oldest one.
+    std::string names;
+    for (std::size_t i = 0; i < 10000; ++i)
+    {
+        names += static_cast<char>('a' + i % 26);
+        queue.Push(MakeMessage(names.back()));
+        if (i >= 100)
+            queue.DropOldest(MessageSize);
+    }
+    isPassed &= Check("drops of a long backlog", Drain(queue) == names.substr(names.size() - 100) ? "in order" : "out of order", "in order");
+    return isPassed;
+}
+
+/**
+* Control messages go ahead of the queued bulk messages, but never ahead of the batch in flight or of a file.
+*/
+static bool CheckControlLane()
+{
+    OutboundQueue queue;
+    queue.Push(MakeMessage('a'));
+    queue.Push(MakeMessage('b'));
+    queue.Push(MakeMessage('X'), MessagePriority::Control);
+    bool isPassed = Check("control message ahead of the bulk ones", DrainBatches(queue), "Xab|");
+
+    queue.Push(MakeMessage('a'));
+    queue.Push(MakeMessage('b'));
+    queue.PrepareBatch();
+    queue.Push(MakeMessage('c'));
+    queue.Push(MakeMessage('X'), MessagePriority::Control);
+    queue.Push(MakeMessage('d'));
+    queue.CompleteBatch();
+    isPassed &= Check("control message queued during a batch", DrainBatches(queue), "Xcd|");
+
+    queue.Push(MakeMessage('a'));
+    queue.PushFile(FileTransfer::Open(FilePath, 0, 1, nullptr));
+    queue.Push(MakeMessage('b'));
+    queue.Push(MakeMessage('X'), MessagePriority::Control);
+    isPassed &= Check("control message ahead of a file", DrainBatches(queue), "Xa|F|b|");
+    return isPassed;
+}
+
+/**
+* The batch limit splits the bulk messages into batches in order, the control messages do not count towards it,
+* and the conflation keys and drops still find the messages that are left after a batch was taken.
+*/
+static bool CheckBatchLimit()
+{
+    OutboundQueue queue(2 * MessageSize);
+    for (char name : std::string("abcde"))
+        queue.Push(MakeMessage(name));
+    queue.Push(MakeMessage('X'), MessagePriority::Control);
+    bool isPassed = Check("batches of the bulk limit", DrainBatches(queue), "Xab|cd|e|");
+
+    queue.PushConflated(MakeMessage('a'), 1);
+    queue.PushConflated(MakeMessage('b'), 2);
+    queue.PushConflated(MakeMessage('c'), 3);
+    queue.PushConflated(MakeMessage('d'), 4);
+    queue.PrepareBatch();
+    queue.PushConflated(MakeMessage('C'), 3);
+    queue.PushConflated(MakeMessage('A'), 1);
+    queue.CompleteBatch();
+    isPassed &= Check("conflation after a limited batch", DrainBatches(queue), "Cd|A|");
+
+    for (char name : std::string("abcdef"))
+        queue.Push(MakeMessage(name));
+    queue.PrepareBatch();
+    queue.CompleteBatch();
+    queue.DropOldest(MessageSize);
+    isPassed &= Check("drop after a limited batch", DrainBatches(queue), "de|f|");
+
+    // a long backlog is taken off the front batch by batch, and keeps its order.
+    std::string expected;
+    for (std::size_t i = 0; i < 10000; ++i)
+    {
+        char name = static_cast<char>('a' + i % 26);
+        queue.Push(MakeMessage(name));
+        expected += name;
+    }
+    isPassed &= Check("order of a long backlog", Drain(queue) == expected ? "in order" : "out of order", "in order");
+    return isPassed;
+}
+
+/**
+* Clearing the messages of a failed client releases both lanes, keeps the batch in flight, and the queue still works.
+*/
+static bool CheckClearMessages()
+{
+    OutboundQueue queue(MessageSize);
+    queue.Push(MakeMessage('a'));
+    queue.Push(MakeMessage('b'));
+    queue.PrepareBatch();
+    queue.PushConflated(MakeMessage('c'), 1);
+    queue.Push(MakeMessage('X'), MessagePriority::Control);
+    queue.ClearMessages();
+    bool isPassed = Check("cleared queue keeps the batch in flight", std::to_string(queue.GetTotalBytes()), std::to_string(MessageSize));
+
+    queue.CompleteBatch();
+    queue.PushConflated(MakeMessage('C'), 1);
+    queue.Push(MakeMessage('d'));
+    isPassed &= Check("messages queued after a clear", DrainBatches(queue), "C|d|");
+    return isPassed;
+}
+
+/**
+* Checks the lanes and the batches of the outbound queue, and its conflation when the oldest messages are dropped
+* to make room, see SlowConsumerPolicy::DropOldest. Every check queues messages named by a letter and compares the
+* order they are written in.
+*/
+int main(int, char** argv)
+{
+    // the test opens its own executable as the file that is queued.
+    FilePath = argv[0];
+
+    bool isPassed = true;
+    isPassed &= CheckKeepMovesOverConflated();
+    isPassed &= CheckKeepInPlace();
+    isPassed &= CheckKeepBeforeFile();
+    isPassed &= CheckDropWithoutKeep();
+    isPassed &= CheckControlLane();
+    isPassed &= CheckBatchLimit();
+    isPassed &= CheckClearMessages();
+
+    printf("\n\n%s\n", isPassed ? "PASSED" : "FAILED");
+    return isPassed ? 0 : 1;
+}
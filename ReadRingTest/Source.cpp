@@ -0,0 +1,184 @@
+#include "TCPServer/FrameAssembler.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace net;
+using namespace net::tcp;
+
+/* Size of the reads that the byte stream is split into, chosen so that the frames never end on a read. */
+static constexpr std::size_t ReadSize = 1000;
+
+/* Number of normal frames that follow the large frame. */
+static constexpr std::size_t NumFramesAfter = 64;
+
+/**
+* Messages that a FrameAssembler delivered from a ring buffer.
+*/
+struct Delivery
+{
+    /* Every complete message, and every streamed message joined from its chunks. */
+    std::vector<std::string>    Messages;
+
+    /* Number of complete messages that were delivered straight from the memory of the ring buffer. */
+    std::size_t                 NumInPlace = 0;
+};
+
+/**
+* Appends a message with its Fixed32 prefix to the byte stream.
+*/
+static void AppendFrame(std::vector<uint8_t>& stream, const std::string& message)
+{
+    uint8_t prefix[MaxFramePrefixSize];
+    std::size_t prefixSize = EncodeFramePrefix(FramePrefix::Fixed32, message.size(), prefix);
+    stream.insert(stream.end(), prefix, prefix + prefixSize);
+    stream.insert(stream.end(), message.begin(), message.end());
+}
+
+/**
+* Returns a message of the given size that is told apart from the others by its index.
+*/
+static std::string MakeMessage(std::size_t index, std::size_t size)
+{
+    std::string message(size, static_cast<char>('a' + index % 26));
+    message[0] = static_cast<char>('A' + index % 26);
+    return message;
+}
+
+/**
+* Reads the byte stream into a ring buffer in ReadSize pieces, like the reads of a client do, and collects the messages.
+*/
+static bool Deliver(const FramingOptions& options, const std::vector<uint8_t>& stream, Delivery& delivery)
+{
+    MirroredRingBuffer ring;
+    if (ring.Allocate(1))
+        return false;
+
+    const uint8_t* ringBegin = ring.GetWriteSpan().data();
+    const uint8_t* ringEnd = ringBegin + 2 * ring.Capacity();
+
+    FrameStreamCallbacks streamCallbacks;
+    streamCallbacks.OnBegin = [&](uint64_t) { delivery.Messages.emplace_back(); };
+    streamCallbacks.OnChunk = [&](std::span<const uint8_t> chunk) { delivery.Messages.back().append(chunk.begin(), chunk.end()); };
+    streamCallbacks.OnEnd = []() {};
+
+    FrameAssembler assembler(options,
+        [&](std::span<const uint8_t> message)
+        {
+            delivery.Messages.emplace_back(message.begin(), message.end());
+            if (message.data() >= ringBegin && message.data() + message.size() <= ringEnd)
+                ++delivery.NumInPlace;
+        },
+        std::move(streamCallbacks));
+
+    for (std::size_t offset = 0; offset < stream.size(); )
+    {
+        std::span<uint8_t> freeSpace = ring.GetWriteSpan();
+        std::size_t size = std::min({ ReadSize, freeSpace.size(), stream.size() - offset });
+
+        std::copy_n(stream.begin() + offset, size, freeSpace.begin());
+        ring.Commit(size);
+        offset += size;
+
+        if (!assembler.FeedRing(ring))
+            return false;
+    }
+
+    return !assembler.HasPartialFrame() && ring.Size() == 0;
+}
+
+/**
+* Compares the delivered messages with the expected ones and reports the check.
+*/
+static bool Check(const char* name, bool isDelivered, const Delivery& delivery, const std::vector<std::string>& expected, std::size_t expectedInPlace)
+{
+    bool isPassed = isDelivered && delivery.Messages == expected && delivery.NumInPlace >= expectedInPlace;
+    printf("\n%-56s : %s (%zu of %zu messages, %zu in place, expected at least %zu)", name, isPassed ? "ok" : "FAILED",
+        delivery.Messages.size(), expected.size(), delivery.NumInPlace, expectedInPlace);
+    return isPassed;
+}
+
+/**
+* A frame larger than the ring buffer is reassembled, and the split frames after it are parsed in place again.
+*/
+static bool CheckOversizedFrame(std::size_t ringCapacity)
+{
+    FramingOptions options;
+    options.Mode = FramingMode::LengthPrefixed;
+
+    std::vector<std::string> expected = { MakeMessage(0, 3 * ringCapacity + 7) };
+    for (std::size_t i = 1; i <= NumFramesAfter; ++i)
+        expected.push_back(MakeMessage(i, 300 + i));
+
+    std::vector<uint8_t> stream;
+    for (const std::string& message : expected)
+        AppendFrame(stream, message);
+
+    Delivery delivery;
+    bool isDelivered = Deliver(options, stream, delivery);
+    return Check("frames after a frame larger than the ring buffer", isDelivered, delivery, expected, NumFramesAfter);
+}
+
+/**
+* A streamed frame is handed to the assembler only up to its end, the split frames after it are parsed in place.
+*/
+static bool CheckStreamedFrame(std::size_t ringCapacity)
+{
+    FramingOptions options;
+    options.Mode = FramingMode::LengthPrefixed;
+    options.StreamingThreshold = 1024;
+
+    std::vector<std::string> expected = { MakeMessage(0, 2 * ringCapacity + 3) };
+    for (std::size_t i = 1; i <= NumFramesAfter; ++i)
+        expected.push_back(MakeMessage(i, 300 + i));
+
+    std::vector<uint8_t> stream;
+    for (const std::string& message : expected)
+        AppendFrame(stream, message);
+
+    Delivery delivery;
+    bool isDelivered = Deliver(options, stream, delivery);
+    return Check("frames after a streamed frame", isDelivered, delivery, expected, NumFramesAfter);
+}
+
+/**
+* A line longer than the ring buffer is reassembled, and the split lines after it are parsed in place again.
+*/
+static bool CheckOversizedLine(std::size_t ringCapacity)
+{
+    FramingOptions options;
+    options.Mode = FramingMode::Delimited;
+
+    std::vector<std::string> expected = { MakeMessage(0, 3 * ringCapacity + 7) };
+    for (std::size_t i = 1; i <= NumFramesAfter; ++i)
+        expected.push_back(MakeMessage(i, 300 + i));
+
+    std::vector<uint8_t> stream;
+    for (const std::string& message : expected)
+    {
+        stream.insert(stream.end(), message.begin(), message.end());
+        stream.insert(stream.end(), options.Delimiter.begin(), options.Delimiter.end());
+    }
+
+    Delivery delivery;
+    bool isDelivered = Deliver(options, stream, delivery);
+    return Check("lines after a line larger than the ring buffer", isDelivered, delivery, expected, NumFramesAfter);
+}
+
+/**
+* Checks that the frames read into a mirrored ring buffer are parsed in place again after a frame that the
+* FrameAssembler had to reassemble or stream, see ServerConfig::UseMirroredReadBuffer.
+*/
+int main()
+{
+    std::size_t ringCapacity = MirroredRingBuffer::GetAllocationGranularity();
+
+    bool isPassed = true;
+    isPassed &= CheckOversizedFrame(ringCapacity);
+    isPassed &= CheckStreamedFrame(ringCapacity);
+    isPassed &= CheckOversizedLine(ringCapacity);
+
+    printf("\n\n%s\n", isPassed ? "PASSED" : "FAILED");
+    return isPassed ? 0 : 1;
+}
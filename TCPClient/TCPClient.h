@@ -1,6 +1,8 @@
 #pragma once
 
 #include "TCPCommon/Common.h"
+#include "TCPCommon/MirroredRingBuffer.h"
+#include "TCPCommon/SocketOptions.h"
 #include <boost/asio.hpp>
 
 
@@ -9,6 +11,7 @@ BEGIN_NAMESPACE_TCP
 
 using OnDataReceivedCallback = std::function<bool(const std::shared_ptr<const std::vector<uint8_t>>&, std::size_t)>;
 using OnDataWrittenCallback = std::function<bool(std::size_t)>;
+using OnBufferedDataReceivedCallback = std::function<bool(MirroredRingBuffer&)>;
 
 
 /**
@@ -26,6 +29,14 @@ public:
     */
     Client();
 
+    /**
+    * Constructs a client whose socket is tuned with the given options.
+    *
+    * @param [in] socketOptions
+    *       Options that are applied to the socket before it connects, see AsyncConnect().
+    */
+    explicit Client(const SocketOptions& socketOptions);
+
     /**
     * Delete the copy constructor.
     */
@@ -34,6 +45,7 @@ public:
     /**
     * This function starts an asynchronous task to connect to the server
     * and will call the OnConnected function.
+    * The socket options of the client are applied before connecting, so the buffer sizes are in place for the handshake.
     * 
     * @param [in] serverHostname
     *       Pame of the server to connect to.
@@ -74,6 +86,22 @@ public:
     */
     bool AsyncRead(OnDataReceivedCallback callback = nullptr);
 
+    /**
+    * This function starts an asynchronous task to read data from the server into a ring buffer owned by the caller.
+    * Every read is appended to the data already in 'buffer'. The callback consumes what it has processed,
+    * e.g. the complete messages, and the rest stays in the buffer, contiguous with the data of the next read.
+    * 
+    * @param [in] buffer
+    *       Ring buffer to read into, it must stay alive while the client is reading.
+    * 
+    * @param [in] callback
+    *       Called after every read, with the buffer that holds all the unconsumed data.
+    * 
+    * @return
+    *       False, if the buffer is not valid or it is full.
+    */
+    bool AsyncRead(MirroredRingBuffer& buffer, OnBufferedDataReceivedCallback callback);
+
 
     /**
     * This function start an async task to write data to the server.
@@ -125,6 +153,7 @@ public:
     * 
     * @param [in] buffer
     *       A shared pointer to the byte data that has been read from the server.
+    *       The client reuses the buffer for the next read, unless a copy of the shared pointer is kept.
     * 
     * @param [in] bytesRead
     *       Number of bytes read from the server.
@@ -187,6 +216,15 @@ private:
     /* Port on which the server is listening for new connections. */
     uint16_t                            m_Port;
 
+    /* Options that are applied to 'm_Socket' before it connects. */
+    SocketOptions                       m_SocketOptions;
+
+    /* Buffer that the data from the server is read into, see AsyncRead(). */
+    std::shared_ptr<std::vector<uint8_t>>   m_ReadBuffer;
+
+    /* Size of 'm_ReadBuffer'. */
+    static constexpr std::size_t        ReadBufferSize = 1024;
+
 };
 
 END_NAMESPACE_TCP
@@ -1,4 +1,5 @@
 #include "TCPClient.h"
+#include "TCPCommon/HandlerAllocator.h"
 
 BEGIN_NAMESPACE_TCP
 
@@ -10,6 +11,13 @@ Client::Client()
 {
 }
 
+// public
+Client::Client(const SocketOptions& socketOptions)
+    : Client()
+{
+    m_SocketOptions = socketOptions;
+}
+
 // public
 bool Client::AsyncConnect(
     const std::string& serverHostname, 
@@ -24,6 +32,13 @@ bool Client::AsyncConnect(
         boost::asio::ip::tcp::resolver::query query(GetServerHostname(), std::to_string(GetPort()));
         boost::asio::ip::tcp::endpoint serverEndpoint = *resolver.resolve(query);
 
+        // the socket is opened here instead of by async_connect(), so that it is tuned before the handshake.
+        if (!GetSocket().is_open())
+            GetSocket().open(serverEndpoint.protocol());
+
+        for (const SocketOptionError& error : ApplySocketOptions(GetSocket(), m_SocketOptions))
+            printf("\nCould not set the socket option %s : %s", error.Name, error.Error.message().c_str());
+
         /* Add a task for connecting to the server before starting the Context Thread. */
         GetSocket().async_connect(serverEndpoint,
             [this](const boost::system::error_code& ec)
@@ -53,9 +68,12 @@ bool Client::AsyncConnect(
 // public
 bool Client::AsyncRead(OnDataReceivedCallback callback)
 {
-    std::shared_ptr<std::vector<uint8_t>> buffer = std::make_shared<std::vector<uint8_t>>(1024);
-    GetSocket().async_read_some(boost::asio::buffer(*buffer),
-        [this, buffer, callback](const boost::system::error_code& ec, std::size_t bytesRead)
+    // the buffer is reused for every read, unless the receiver of the previous read still holds a reference to it.
+    if (!m_ReadBuffer || m_ReadBuffer.use_count() > 1)
+        m_ReadBuffer = std::make_shared<std::vector<uint8_t>>(ReadBufferSize);
+
+    GetSocket().async_read_some(boost::asio::buffer(*m_ReadBuffer),
+        BindRecyclingAllocator([this, callback](const boost::system::error_code& ec, std::size_t bytesRead)
         {
             if (ec == boost::asio::error::eof)
             {
@@ -70,13 +88,52 @@ bool Client::AsyncRead(OnDataReceivedCallback callback)
             }
 
             if (callback)
-                callback(buffer, bytesRead);
+                callback(m_ReadBuffer, bytesRead);
             else
-                OnDataReceived(buffer, bytesRead);
+                OnDataReceived(m_ReadBuffer, bytesRead);
 
             /* Add another async read task to the context. */
             AsyncRead();
-        });
+        }));
+
+    return true;
+}
+
+// public
+bool Client::AsyncRead(MirroredRingBuffer& buffer, OnBufferedDataReceivedCallback callback)
+{
+    if (!buffer.IsValid() || !callback)
+        return false;
+
+    // a full buffer means the callback could not consume anything, reading more would not make any progress.
+    if (buffer.FreeSpace() == 0)
+    {
+        OnDataReceivedError("The read buffer is full");
+        return false;
+    }
+
+    std::span<uint8_t> freeSpace = buffer.GetWriteSpan();
+    GetSocket().async_read_some(boost::asio::buffer(freeSpace.data(), freeSpace.size()),
+        BindRecyclingAllocator([this, &buffer, callback = std::move(callback)](const boost::system::error_code& ec, std::size_t bytesRead) mutable
+        {
+            if (ec == boost::asio::error::eof)
+            {
+                OnDisconnection();
+                return;
+            }
+
+            if (ec)
+            {
+                OnDataReceivedError(ec.message());
+                return;
+            }
+
+            buffer.Commit(bytesRead);
+            callback(buffer);
+
+            /* Add another async read task to the context. */
+            AsyncRead(buffer, std::move(callback));
+        }));
 
     return true;
 }
@@ -95,7 +152,7 @@ void Client::AsyncWrite(const std::vector<uint8_t>& buffer, std::size_t bytesToW
         bytesToWrite = buffer.size();
 
     GetSocket().async_write_some(boost::asio::buffer(buffer.data(), bytesToWrite),
-        [this, callback](const boost::system::error_code& ec, std::size_t bytesWritten)
+        BindRecyclingAllocator([this, callback](const boost::system::error_code& ec, std::size_t bytesWritten)
         {
             if (ec)
             {
@@ -107,7 +164,7 @@ void Client::AsyncWrite(const std::vector<uint8_t>& buffer, std::size_t bytesToW
                 callback(bytesWritten);
             else
                 OnDataWritten(bytesWritten);
-        });
+        }));
 }
 
 // public
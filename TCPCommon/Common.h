@@ -21,7 +21,7 @@
 /****************************************************/
 BEGIN_NAMESPACE_TCP
 
-using ClientID = std::size_t;
+using ClientID = uint64_t;
 
 class Server;
 using ServerSPtr = std::shared_ptr<Server>;
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <bit>
+#include <cstring>
+#include <span>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define NET_SIMD_X86 1
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define NET_TARGET_AVX2
+    #else
+        #include <immintrin.h>
+        #define NET_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#else
+    #define NET_SIMD_X86 0
+#endif
+
+BEGIN_NAMESPACE_NET
+
+/**
+* Finds a delimiter, e.g. CRLF, in a byte stream.
+*
+* On x86 the bytes are scanned 32 (AVX2) or 16 (SSE2) at a time: a block is compared against the first and the last
+* byte of the delimiter at once, and only the positions where both match are verified. The instruction set is picked
+* once at runtime, other platforms use a scalar memchr based scan.
+*/
+class DelimiterScanner
+{
+public:
+
+    /* Returned by Find() when the delimiter is not found. */
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+    * @param [in] delimiter
+    *       Delimiter to search for, must not be empty. It is referenced, not copied.
+    */
+    explicit DelimiterScanner(std::span<const uint8_t> delimiter)
+        : m_Delimiter(delimiter)
+    {
+    }
+
+    /**
+    * Returns the offset of the first occurrence of the delimiter in 'data', npos if it is not present.
+    */
+    std::size_t Find(std::span<const uint8_t> data) const
+    {
+        if (data.size() < m_Delimiter.size())
+            return npos;
+
+        return GetFindFunction()(data.data(), data.size(), m_Delimiter.data(), m_Delimiter.size());
+    }
+
+    /**
+    * Returns the name of the implementation that is used on this CPU, e.g. for logging.
+    */
+    static const char* GetImplementationName()
+    {
+#if NET_SIMD_X86
+        return CpuSupportsAVX2() ? "AVX2" : "SSE2";
+#else
+        return "Scalar";
+#endif
+    }
+
+private:
+
+    using FindFunction = std::size_t(*)(const uint8_t*, std::size_t, const uint8_t*, std::size_t);
+
+    static FindFunction GetFindFunction()
+    {
+#if NET_SIMD_X86
+        static const FindFunction findFunction = CpuSupportsAVX2() ? &FindAVX2 : &FindSSE2;
+        return findFunction;
+#else
+        return &FindScalar;
+#endif
+    }
+
+    static std::size_t FindScalar(const uint8_t* data, std::size_t size, const uint8_t* delimiter, std::size_t delimiterSize)
+    {
+        return FindScalarFrom(data, size, 0, delimiter, delimiterSize);
+    }
+
+    /* Scalar scan starting at 'offset', used by the SIMD scans for the tail that does not fill a block. */
+    static std::size_t FindScalarFrom(const uint8_t* data, std::size_t size, std::size_t offset, const uint8_t* delimiter, std::size_t delimiterSize)
+    {
+        while (offset + delimiterSize <= size)
+        {
+            const void* first = std::memchr(data + offset, delimiter[0], size - delimiterSize + 1 - offset);
+            if (!first)
+                return npos;
+
+            offset = static_cast<const uint8_t*>(first) - data;
+            if (std::memcmp(data + offset + 1, delimiter + 1, delimiterSize - 1) == 0)
+                return offset;
+
+            ++offset;
+        }
+
+        return npos;
+    }
+
+#if NET_SIMD_X86
+    static bool CpuSupportsAVX2()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX needs the OS to save the YMM registers.
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    static std::size_t FindSSE2(const uint8_t* data, std::size_t size, const uint8_t* delimiter, std::size_t delimiterSize)
+    {
+        const __m128i first = _mm_set1_epi8(static_cast<char>(delimiter[0]));
+        const __m128i last = _mm_set1_epi8(static_cast<char>(delimiter[delimiterSize - 1]));
+
+        std::size_t offset = 0;
+        for (; offset + delimiterSize - 1 + 16 <= size; offset += 16)
+        {
+            __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+            __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + delimiterSize - 1));
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+
+            while (mask)
+            {
+                std::size_t candidate = offset + std::countr_zero(mask);
+                if (delimiterSize <= 2 || std::memcmp(data + candidate + 1, delimiter + 1, delimiterSize - 2) == 0)
+                    return candidate;
+
+                mask &= mask - 1;
+            }
+        }
+
+        return FindScalarFrom(data, size, offset, delimiter, delimiterSize);
+    }
+
+    NET_TARGET_AVX2 static std::size_t FindAVX2(const uint8_t* data, std::size_t size, const uint8_t* delimiter, std::size_t delimiterSize)
+    {
+        const __m256i first = _mm256_set1_epi8(static_cast<char>(delimiter[0]));
+        const __m256i last = _mm256_set1_epi8(static_cast<char>(delimiter[delimiterSize - 1]));
+
+        std::size_t offset = 0;
+        for (; offset + delimiterSize - 1 + 32 <= size; offset += 32)
+        {
+            __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+            __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset + delimiterSize - 1));
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+
+            while (mask)
+            {
+                std::size_t candidate = offset + std::countr_zero(mask);
+                if (delimiterSize <= 2 || std::memcmp(data + candidate + 1, delimiter + 1, delimiterSize - 2) == 0)
+                    return candidate;
+
+                mask &= mask - 1;
+            }
+        }
+
+        // the tail, shorter than a 32 byte block, is handled by the SSE2 scan.
+        std::size_t tail = FindSSE2(data + offset, size - offset, delimiter, delimiterSize);
+        return tail == npos ? npos : offset + tail;
+    }
+#endif
+
+private:
+
+    /* Delimiter to search for. */
+    std::span<const uint8_t> m_Delimiter;
+};
+
+END_NAMESPACE_NET
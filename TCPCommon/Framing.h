@@ -0,0 +1,181 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <string>
+
+BEGIN_NAMESPACE_NET
+
+/**
+* How a byte stream is split into messages.
+*/
+enum class FramingMode
+{
+    /* No framing, the raw chunks read from the socket are delivered as they are. */
+    None,
+
+    /* Every message is preceded by its length, see FramePrefix. */
+    LengthPrefixed,
+
+    /* Every message is terminated by a delimiter, e.g. CRLF for line based text protocols. */
+    Delimited,
+};
+
+/**
+* Encoding of the length that precedes every message in FramingMode::LengthPrefixed.
+*/
+enum class FramePrefix
+{
+    /* 4 bytes, unsigned, little endian. */
+    Fixed32,
+
+    /* 1 to 10 bytes, unsigned LEB128: 7 bits per byte, least significant group first, high bit set on all but the last byte. */
+    Varint,
+};
+
+/**
+* Settings of the framing layer of a connection.
+*/
+struct FramingOptions
+{
+    /* How the byte stream is split into messages. */
+    FramingMode     Mode = FramingMode::None;
+
+    /* Encoding of the length prefix, used in FramingMode::LengthPrefixed. */
+    FramePrefix     Prefix = FramePrefix::Fixed32;
+
+    /* Delimiter that terminates every message, used in FramingMode::Delimited. Must not be empty. */
+    std::string     Delimiter = CRLF;
+
+    /* Largest message that is accepted, a peer that sends a larger message is disconnected. Applies to streamed messages too. */
+    std::size_t     MaxFrameSize = 16 * 1024 * 1024;
+
+    /*
+    * Used in FramingMode::LengthPrefixed, 0 disables streaming.
+    * Messages larger than this are not buffered, they are delivered in chunks as they arrive instead,
+    * e.g. through Server::OnMessageBegin(), OnMessageChunk() and OnMessageEnd(). Raise MaxFrameSize to accept large uploads.
+    */
+    std::size_t     StreamingThreshold = 0;
+};
+
+/**
+* Result of decoding a frame prefix.
+*/
+enum class FramePrefixStatus
+{
+    /* The prefix was decoded. */
+    Complete,
+
+    /* More bytes are needed to decode the prefix. */
+    Incomplete,
+
+    /* The bytes do not form a valid prefix. */
+    Invalid,
+};
+
+/* Largest number of bytes that a frame prefix can take. */
+constexpr std::size_t MaxFramePrefixSize = 10;
+
+/**
+* Encodes the length of a frame.
+*
+* @param [in] prefix
+*       Encoding of the length.
+*
+* @param [in] length
+*       Length of the frame, excluding the prefix.
+*
+* @param [out] out
+*       Buffer of at least MaxFramePrefixSize bytes, that receives the encoded prefix.
+*
+* @return
+*       Number of bytes written to 'out'.
+*/
+inline std::size_t EncodeFramePrefix(FramePrefix prefix, uint64_t length, uint8_t* out)
+{
+    if (prefix == FramePrefix::Fixed32)
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+            out[i] = static_cast<uint8_t>(length >> (8 * i));
+
+        return 4;
+    }
+
+    std::size_t size = 0;
+    do
+    {
+        uint8_t byte = static_cast<uint8_t>(length & 0x7F);
+        length >>= 7;
+        out[size++] = length ? (byte | 0x80) : byte;
+    } while (length);
+
+    return size;
+}
+
+/**
+* Decodes the length of a frame.
+*
+* @param [in] prefix
+*       Encoding of the length.
+*
+* @param [in] data
+*       Bytes at the start of the frame.
+*
+* @param [in] size
+*       Number of bytes available at 'data'.
+*
+* @param [in] maxLength
+*       Largest length that is accepted, a larger one makes the prefix invalid.
+*
+* @param [out] length
+*       Length of the frame, excluding the prefix.
+*
+* @param [out] prefixSize
+*       Number of bytes taken by the prefix.
+*/
+inline FramePrefixStatus DecodeFramePrefix(FramePrefix prefix, const uint8_t* data, std::size_t size, uint64_t maxLength,
+    uint64_t& length, std::size_t& prefixSize)
+{
+    if (prefix == FramePrefix::Fixed32)
+    {
+        if (size < 4)
+            return FramePrefixStatus::Incomplete;
+
+        length = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+            length |= static_cast<uint64_t>(data[i]) << (8 * i);
+
+        if (length > maxLength)
+            return FramePrefixStatus::Invalid;
+
+        prefixSize = 4;
+        return FramePrefixStatus::Complete;
+    }
+
+    length = 0;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        if (i == MaxFramePrefixSize)
+            return FramePrefixStatus::Invalid;
+
+        // the last byte holds the one bit that is left of the 64, anything more would be cut off.
+        std::size_t shift = 7 * i;
+        if (shift == 63 && data[i] > 1)
+            return FramePrefixStatus::Invalid;
+
+        length |= static_cast<uint64_t>(data[i] & 0x7F) << shift;
+
+        // the following bytes can only add to the length, so it is rejected as soon as it is too large.
+        if (length > maxLength)
+            return FramePrefixStatus::Invalid;
+
+        if ((data[i] & 0x80) == 0)
+        {
+            prefixSize = i + 1;
+            return FramePrefixStatus::Complete;
+        }
+    }
+
+    return size >= MaxFramePrefixSize ? FramePrefixStatus::Invalid : FramePrefixStatus::Incomplete;
+}
+
+END_NAMESPACE_NET
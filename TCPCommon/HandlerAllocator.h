@@ -0,0 +1,151 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <boost/asio/bind_allocator.hpp>
+#include <boost/asio/recycling_allocator.hpp>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+BEGIN_NAMESPACE_NET
+
+/**
+* Associates a completion handler with asio's per-thread recycling allocator.
+*
+* The memory of an asynchronous operation is then taken from, and given back to, a small cache of the thread
+* that runs the handler, so a steady read/write loop reuses the same blocks instead of going to the heap.
+*
+* @param [in] handler
+*       Completion handler of an asynchronous operation, or a function passed to dispatch()/post().
+*
+* @return
+*       The handler, bound to the recycling allocator.
+*/
+template <typename Handler>
+inline auto BindRecyclingAllocator(Handler&& handler)
+{
+    return boost::asio::bind_allocator(boost::asio::recycling_allocator<void>(), std::forward<Handler>(handler));
+}
+
+/**
+* Move-only function whose target is stored in memory of asio's per-thread recycling allocator.
+*
+* Used instead of std::function for completion handlers that are stored across an asynchronous operation, whose
+* captures, e.g. a pointer and a shared_ptr, do not fit the small buffer of std::function and would otherwise be
+* allocated from the heap on every operation.
+*/
+template <typename Signature>
+class RecyclingFunction;
+
+template <typename Result, typename... Args>
+class RecyclingFunction<Result(Args...)>
+{
+public:
+
+    RecyclingFunction() = default;
+
+    RecyclingFunction(std::nullptr_t)
+    {
+    }
+
+    template <typename Function, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Function>, RecyclingFunction>>>
+    RecyclingFunction(Function&& function)
+        : m_Target(Target<std::decay_t<Function>>::Create(std::forward<Function>(function)))
+    {
+    }
+
+    RecyclingFunction(RecyclingFunction&& other) noexcept
+        : m_Target(std::exchange(other.m_Target, nullptr))
+    {
+    }
+
+    RecyclingFunction& operator=(RecyclingFunction&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_Target = std::exchange(other.m_Target, nullptr);
+        }
+        return *this;
+    }
+
+    RecyclingFunction& operator=(std::nullptr_t)
+    {
+        Reset();
+        return *this;
+    }
+
+    RecyclingFunction(const RecyclingFunction&) = delete;
+    RecyclingFunction& operator=(const RecyclingFunction&) = delete;
+
+    ~RecyclingFunction()
+    {
+        Reset();
+    }
+
+    explicit operator bool() const { return m_Target != nullptr; }
+
+    Result operator()(Args... args) const
+    {
+        return m_Target->Invoke(std::forward<Args>(args)...);
+    }
+
+private:
+
+    struct TargetBase
+    {
+        virtual Result Invoke(Args... args) = 0;
+        virtual void Destroy() = 0;
+
+    protected:
+        ~TargetBase() = default;
+    };
+
+    template <typename Function>
+    struct Target final : TargetBase
+    {
+        using Allocator = boost::asio::recycling_allocator<Target>;
+
+        template <typename F>
+        explicit Target(F&& function)
+            : m_Function(std::forward<F>(function))
+        {
+        }
+
+        template <typename F>
+        static TargetBase* Create(F&& function)
+        {
+            Allocator allocator;
+            Target* target = allocator.allocate(1);
+            return new (target) Target(std::forward<F>(function));
+        }
+
+        Result Invoke(Args... args) override
+        {
+            return m_Function(std::forward<Args>(args)...);
+        }
+
+        void Destroy() override
+        {
+            Allocator allocator;
+            this->~Target();
+            allocator.deallocate(this, 1);
+        }
+
+        Function m_Function;
+    };
+
+    void Reset()
+    {
+        if (m_Target)
+            std::exchange(m_Target, nullptr)->Destroy();
+    }
+
+private:
+
+    /* Stored function, nullptr if empty. */
+    TargetBase* m_Target = nullptr;
+};
+
+END_NAMESPACE_NET
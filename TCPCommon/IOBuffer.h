@@ -1,6 +1,8 @@
 #pragma once
 
 #include "TCPCommon/Common.h"
+#include "TCPCommon/SharedPayload.h"
+#include "TCPCommon/Framing.h"
 #include <vector>
 #include <string>
 
@@ -30,6 +32,44 @@ public:
     */
     void Clear() { m_Buffer.clear(); }
 
+    /**
+    * Copies the buffer into a SharedPayload, that can be sent to any number of clients without any more copies.
+    */
+    SharedPayload ToSharedPayload() const { return SharedPayload::Copy(m_Buffer.data(), m_Buffer.size()); }
+
+    /**
+    * Moves the buffer into a SharedPayload without copying it. The IOBuffer is empty afterwards.
+    */
+    SharedPayload ReleaseSharedPayload()
+    {
+        SharedPayload payload = SharedPayload::Create(std::move(m_Buffer));
+        m_Buffer.clear();
+        return payload;
+    }
+
+    /**
+    * Returns the buffer as a single length-prefixed frame, that is delivered as one message
+    * by a connection using FramingMode::LengthPrefixed with the same prefix.
+    * 
+    * @param [in] prefix
+    *       Encoding of the length prefix.
+    */
+    std::vector<uint8_t> ToFrame(FramePrefix prefix) const
+    {
+        std::vector<uint8_t> frame(MaxFramePrefixSize + m_Buffer.size());
+        std::size_t prefixSize = EncodeFramePrefix(prefix, m_Buffer.size(), frame.data());
+
+        std::memcpy(frame.data() + prefixSize, m_Buffer.data(), m_Buffer.size());
+        frame.resize(prefixSize + m_Buffer.size());
+
+        return frame;
+    }
+
+    /**
+    * Same as ToFrame(), but returns the frame as a SharedPayload, ready to be sent to any number of clients.
+    */
+    SharedPayload ToFramedPayload(FramePrefix prefix) const { return SharedPayload::Create(ToFrame(prefix)); }
+
     /**
     * Writes data to the Stream.
     * 
@@ -0,0 +1,318 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <boost/system/error_code.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <span>
+#include <string>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+        #define NET_UNDEF_WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+        #define NET_UNDEF_NOMINMAX
+    #endif
+    #include <windows.h>
+    #ifdef NET_UNDEF_WIN32_LEAN_AND_MEAN
+        #undef WIN32_LEAN_AND_MEAN
+        #undef NET_UNDEF_WIN32_LEAN_AND_MEAN
+    #endif
+    #ifdef NET_UNDEF_NOMINMAX
+        #undef NOMINMAX
+        #undef NET_UNDEF_NOMINMAX
+    #endif
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+BEGIN_NAMESPACE_NET
+
+/**
+* Receive ring buffer whose memory is mapped twice, back to back, in the virtual address space.
+*
+* Byte 'Capacity() + i' is the same memory as byte 'i', so the free space and the buffered data are always
+* contiguous, however they wrap around the end of the ring. Reads go straight into the free space, and a message
+* that is split across reads can be parsed in place once the rest of it arrives, without any compaction copy.
+*
+* The capacity is rounded up to the allocation granularity of the OS (the page size on POSIX, 64 KB on Windows).
+* This class is not thread safe.
+*/
+class MirroredRingBuffer
+{
+public:
+
+    MirroredRingBuffer() = default;
+
+    MirroredRingBuffer(const MirroredRingBuffer&) = delete;
+    MirroredRingBuffer& operator=(const MirroredRingBuffer&) = delete;
+
+    ~MirroredRingBuffer() { Release(); }
+
+    /**
+    * Maps the memory of the ring buffer, any previous memory is released.
+    *
+    * @param [in] minCapacity
+    *       Minimum number of bytes that the ring buffer must hold.
+    *
+    * @return
+    *       Empty, if the memory is mapped. Otherwise the error of the OS, for the caller to log, and the buffer is not
+    *       valid.
+    */
+    boost::system::error_code Allocate(std::size_t minCapacity)
+    {
+        Release();
+
+        std::size_t granularity = GetAllocationGranularity();
+        std::size_t capacity = ((std::max<std::size_t>(minCapacity, 1) + granularity - 1) / granularity) * granularity;
+
+        if (boost::system::error_code ec = MapMirrored(capacity))
+            return ec;
+
+        m_Capacity = capacity;
+        return boost::system::error_code();
+    }
+
+    /**
+    * Returns true if the memory of the ring buffer is mapped.
+    */
+    bool IsValid() const { return m_Data != nullptr; }
+
+    /**
+    * Returns the number of bytes that the ring buffer can hold.
+    */
+    std::size_t Capacity() const { return m_Capacity; }
+
+    /**
+    * Returns the number of buffered bytes.
+    */
+    std::size_t Size() const { return m_Size; }
+
+    /**
+    * Returns the number of bytes that can still be written.
+    */
+    std::size_t FreeSpace() const { return m_Capacity - m_Size; }
+
+    /**
+    * Returns the free space of the ring buffer as one contiguous span, to read data into.
+    * The bytes become part of the buffered data with Commit().
+    */
+    std::span<uint8_t> GetWriteSpan() { return std::span<uint8_t>(m_Data + (m_ReadOffset + m_Size) % std::max<std::size_t>(m_Capacity, 1), FreeSpace()); }
+
+    /**
+    * Appends the given number of bytes at the start of GetWriteSpan() to the buffered data.
+    */
+    void Commit(std::size_t size) { m_Size += std::min(size, FreeSpace()); }
+
+    /**
+    * Returns the buffered data as one contiguous span.
+    */
+    std::span<const uint8_t> GetReadSpan() const { return std::span<const uint8_t>(m_Data + m_ReadOffset, m_Size); }
+
+    /**
+    * Removes the given number of bytes from the start of the buffered data.
+    */
+    void Consume(std::size_t size)
+    {
+        size = std::min(size, m_Size);
+        m_Size -= size;
+
+        // start from the beginning again when empty, so that the next reads touch the same pages.
+        m_ReadOffset = m_Size ? (m_ReadOffset + size) % m_Capacity : 0;
+    }
+
+    /**
+    * Removes all the buffered data.
+    */
+    void Clear() { Consume(m_Size); }
+
+    /**
+    * Returns the granularity that the capacity is rounded up to.
+    */
+    static std::size_t GetAllocationGranularity()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwAllocationGranularity;
+#else
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+private:
+
+#if defined(_WIN32)
+
+    /* Number of times the mapping is retried, when another thread takes the reserved address range in between. */
+    static constexpr int MaxMapAttempts = 16;
+
+    static boost::system::error_code GetLastSystemError()
+    {
+        return boost::system::error_code(static_cast<int>(GetLastError()), boost::system::system_category());
+    }
+
+    boost::system::error_code MapMirrored(std::size_t capacity)
+    {
+        const uint64_t mappingSize = capacity;
+        HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(mappingSize >> 32), static_cast<DWORD>(mappingSize), nullptr);
+
+        if (!mapping)
+            return GetLastSystemError();
+
+        // find a free range of twice the capacity, then map the same memory into both of its halves.
+        boost::system::error_code ec;
+        for (int attempt = 0; attempt < MaxMapAttempts; ++attempt)
+        {
+            void* region = VirtualAlloc(nullptr, 2 * capacity, MEM_RESERVE, PAGE_NOACCESS);
+            if (!region)
+            {
+                ec = GetLastSystemError();
+                break;
+            }
+
+            VirtualFree(region, 0, MEM_RELEASE);
+
+            uint8_t* first = static_cast<uint8_t*>(MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity, region));
+            if (!first)
+            {
+                ec = GetLastSystemError();
+                continue;
+            }
+
+            uint8_t* second = static_cast<uint8_t*>(MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity, first + capacity));
+            if (!second)
+            {
+                ec = GetLastSystemError();
+                UnmapViewOfFile(first);
+                continue;
+            }
+
+            m_Mapping = mapping;
+            m_Data = first;
+            return boost::system::error_code();
+        }
+
+        CloseHandle(mapping);
+        return ec;
+    }
+
+    void Release()
+    {
+        if (m_Data)
+        {
+            UnmapViewOfFile(m_Data + m_Capacity);
+            UnmapViewOfFile(m_Data);
+        }
+
+        if (m_Mapping)
+            CloseHandle(m_Mapping);
+
+        m_Mapping = nullptr;
+        ResetState();
+    }
+
+#else
+
+    static boost::system::error_code GetLastSystemError()
+    {
+        return boost::system::error_code(errno, boost::system::system_category());
+    }
+
+    boost::system::error_code MapMirrored(std::size_t capacity)
+    {
+        int fd = CreateSharedMemory();
+        if (fd < 0)
+            return GetLastSystemError();
+
+        if (ftruncate(fd, static_cast<off_t>(capacity)) != 0)
+        {
+            boost::system::error_code ec = GetLastSystemError();
+            close(fd);
+            return ec;
+        }
+
+        // reserve twice the capacity, then map the same memory over both of its halves.
+        void* region = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        bool mapped = region != MAP_FAILED
+            && mmap(region, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED
+            && mmap(static_cast<uint8_t*>(region) + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+
+        // taken before close() and munmap() can overwrite it. The mappings keep the memory alive.
+        boost::system::error_code ec = mapped ? boost::system::error_code() : GetLastSystemError();
+        close(fd);
+
+        if (!mapped)
+        {
+            if (region != MAP_FAILED)
+                munmap(region, 2 * capacity);
+            return ec;
+        }
+
+        m_Data = static_cast<uint8_t*>(region);
+        return boost::system::error_code();
+    }
+
+    static int CreateSharedMemory()
+    {
+#if defined(__linux__)
+        return memfd_create("net_ring_buffer", MFD_CLOEXEC);
+#else
+        // an anonymous object is emulated with a unique name that is unlinked right away.
+        static std::atomic<uint32_t> counter = 0;
+        std::string name = "/net_ring_buffer_" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            shm_unlink(name.c_str());
+
+        return fd;
+#endif
+    }
+
+    void Release()
+    {
+        if (m_Data)
+            munmap(m_Data, 2 * m_Capacity);
+
+        ResetState();
+    }
+
+#endif
+
+    void ResetState()
+    {
+        m_Data = nullptr;
+        m_Capacity = 0;
+        m_ReadOffset = 0;
+        m_Size = 0;
+    }
+
+private:
+
+    /* Start of the first of the two mappings, the second one follows right after it. */
+    uint8_t*        m_Data = nullptr;
+
+    /* Size of each of the two mappings. */
+    std::size_t     m_Capacity = 0;
+
+    /* Offset of the first buffered byte, always less than m_Capacity. */
+    std::size_t     m_ReadOffset = 0;
+
+    /* Number of buffered bytes. */
+    std::size_t     m_Size = 0;
+
+#if defined(_WIN32)
+    /* File mapping that backs both the views. */
+    HANDLE          m_Mapping = nullptr;
+#endif
+};
+
+END_NAMESPACE_NET
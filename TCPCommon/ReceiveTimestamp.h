@@ -0,0 +1,129 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <boost/asio.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#if defined(__linux__)
+    #include <sys/socket.h>
+    #include <time.h>
+#endif
+
+BEGIN_NAMESPACE_NET
+
+/* Clock of the receive timestamps, the kernel stamps the packets with the wall clock. */
+using ReceiveClock = std::chrono::system_clock;
+
+/**
+* Asks the kernel to timestamp the data that arrives on the socket, see ReceiveWithTimestamp().
+*
+* @param [in] socket
+*       Socket to enable the timestamps on.
+*
+* @return
+*       Empty, if the kernel timestamps the data. Otherwise why it does not, operation_not_supported on the platforms
+*       where only the time of the read is available, for the caller to log.
+*/
+inline boost::system::error_code EnableReceiveTimestamps(boost::asio::ip::tcp::socket& socket)
+{
+#if defined(__linux__) && defined(SO_TIMESTAMPNS)
+    int enable = 1;
+    if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) != 0)
+        return boost::system::error_code(errno, boost::asio::error::get_system_category());
+
+    return boost::system::error_code();
+#else
+    (void)socket;
+    return boost::asio::error::operation_not_supported;
+#endif
+}
+
+/**
+* Non-blocking read from the socket, that also returns the time at which the kernel received the data.
+* On Linux this reads with recvmsg() and takes the SCM_TIMESTAMPNS control message, elsewhere, or when the kernel
+* attached no timestamp, the time of the read is returned instead.
+*
+* @param [in] socket
+*       Socket to read from, must be in non-blocking mode.
+*
+* @param [in] buffer
+*       Memory to read into.
+*
+* @param [out] ec
+*       Set as by read_some(), would_block when the socket has no data, eof when the peer closed the connection.
+*
+* @param [out] timestamp
+*       Receive time of the data that was read, the latest one when the data arrived in multiple packets.
+*
+* @param [out] isKernelTimestamp
+*       True, if the kernel stamped the data, false if 'timestamp' is only the time of the read.
+*
+* @return
+*       Number of bytes read.
+*/
+inline std::size_t ReceiveWithTimestamp(boost::asio::ip::tcp::socket& socket, boost::asio::mutable_buffer buffer,
+    boost::system::error_code& ec, ReceiveClock::time_point& timestamp, bool& isKernelTimestamp)
+{
+#if defined(__linux__) && defined(SO_TIMESTAMPNS)
+    ec.clear();
+
+    iovec iov;
+    iov.iov_base = buffer.data();
+    iov.iov_len = buffer.size();
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec))];
+
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t bytesRead;
+    do
+    {
+        bytesRead = recvmsg(socket.native_handle(), &message, 0);
+    }
+    while (bytesRead < 0 && errno == EINTR);
+
+    timestamp = ReceiveClock::now();
+    isKernelTimestamp = false;
+
+    if (bytesRead < 0)
+    {
+        ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+        return 0;
+    }
+
+    if (bytesRead == 0 && buffer.size() != 0)
+    {
+        ec = boost::asio::error::eof;
+        return 0;
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec time;
+            memcpy(&time, CMSG_DATA(cmsg), sizeof(time));
+
+            timestamp = ReceiveClock::time_point(std::chrono::duration_cast<ReceiveClock::duration>(
+                std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec)));
+            isKernelTimestamp = true;
+            break;
+        }
+    }
+
+    return static_cast<std::size_t>(bytesRead);
+#else
+    std::size_t bytesRead = socket.read_some(buffer, ec);
+    timestamp = ReceiveClock::now();
+    isKernelTimestamp = false;
+    return bytesRead;
+#endif
+}
+
+END_NAMESPACE_NET
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <memory>
+#include <vector>
+#include <cstring>
+
+BEGIN_NAMESPACE_NET
+
+/**
+* Immutable, reference counted byte data.
+*
+* A payload is created once and can then be queued to any number of clients without copying the bytes,
+* every copy of a SharedPayload only adds a reference to the same data.
+*/
+class SharedPayload
+{
+public:
+
+    SharedPayload() = default;
+
+    /**
+    * Creates a payload by copying the given bytes into a single allocation.
+    *
+    * @param [in] data
+    *       Pointer to the bytes to be copied.
+    *
+    * @param [in] size
+    *       Number of bytes to be copied.
+    */
+    static SharedPayload Copy(const uint8_t* data, std::size_t size)
+    {
+        if (size == 0)
+            return SharedPayload();
+
+        std::shared_ptr<uint8_t[]> bytes = std::make_shared_for_overwrite<uint8_t[]>(size);
+        std::memcpy(bytes.get(), data, size);
+
+        return SharedPayload(std::move(bytes), size);
+    }
+
+    /**
+    * Creates a payload by taking the ownership of a vector, the bytes are not copied.
+    *
+    * @param [in] data
+    *       Vector whose bytes will be owned by the payload.
+    */
+    static SharedPayload Create(std::vector<uint8_t>&& data)
+    {
+        if (data.empty())
+            return SharedPayload();
+
+        auto holder = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        std::size_t size = holder->size();
+
+        // aliasing constructor: shares the ownership of 'holder', but points to its bytes.
+        return SharedPayload(std::shared_ptr<const uint8_t[]>(holder, holder->data()), size);
+    }
+
+    /**
+    * Returns the pointer to the bytes of the payload.
+    */
+    const uint8_t* Data() const { return m_Data.get(); }
+
+    /**
+    * Returns the number of bytes of the payload.
+    */
+    std::size_t Size() const { return m_Size; }
+
+    /**
+    * Returns true if the payload does not contain any bytes.
+    */
+    bool IsEmpty() const { return m_Size == 0; }
+
+private:
+
+    SharedPayload(std::shared_ptr<const uint8_t[]> data, std::size_t size)
+        : m_Data(std::move(data))
+        , m_Size(size)
+    {
+    }
+
+private:
+
+    /* The bytes of the payload, shared by every copy of the payload. */
+    std::shared_ptr<const uint8_t[]>    m_Data;
+
+    /* Number of bytes of the payload. */
+    std::size_t                         m_Size = 0;
+};
+
+END_NAMESPACE_NET
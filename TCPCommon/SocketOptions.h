@@ -0,0 +1,162 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#if !defined(_WIN32)
+    #include <netinet/tcp.h>
+#endif
+
+BEGIN_NAMESPACE_NET
+
+/**
+* Options of a TCP socket, applied to the sockets of a Server when they are accepted and to a Client before it connects.
+* Options that are not set are left at the default of the OS.
+*/
+struct SocketOptions
+{
+    /* TCP_NODELAY, sends small writes right away instead of waiting to coalesce them (Nagle's algorithm). */
+    std::optional<bool>                         NoDelay;
+
+    /* SO_SNDBUF and SO_RCVBUF, sizes of the kernel buffers of the socket in bytes. */
+    std::optional<int>                          SendBufferSize;
+    std::optional<int>                          ReceiveBufferSize;
+
+    /*
+    * TCP_NOTSENT_LOWAT, the socket only reports that it is writable while less than this many bytes wait unsent in its
+    * send buffer. Keeps the queued data in the process, where it can still be coalesced or dropped, instead of letting
+    * it pile up in the kernel, which cuts the tail latency of the writes. Linux and macOS only.
+    */
+    std::optional<int>                          NotSentLowWatermark;
+
+    /* TCP_QUICKACK, sends ACKs right away instead of delaying them. The kernel may go back to delayed ACKs later. Linux only. */
+    std::optional<bool>                         QuickAck;
+
+    /* SO_KEEPALIVE, and when to send the first probe of an idle connection, the interval of the probes and how many are sent. */
+    std::optional<bool>                         KeepAlive;
+    std::optional<std::chrono::seconds>         KeepAliveIdle;
+    std::optional<std::chrono::seconds>         KeepAliveInterval;
+    std::optional<int>                          KeepAliveCount;
+
+    /* TCP_USER_TIMEOUT, how long sent data may stay unacknowledged before the connection is dropped. Linux only. */
+    std::optional<std::chrono::milliseconds>    UserTimeout;
+};
+
+/**
+* Option that could not be applied to a socket, see ApplySocketOptions().
+*/
+struct SocketOptionError
+{
+    /* Name of the option, e.g. "TCP_NODELAY". */
+    const char*                 Name;
+
+    /* Why it failed, boost::asio::error::operation_not_supported if the platform does not have the option. */
+    boost::system::error_code   Error;
+};
+
+/**
+* Applies the options that are set to a socket. The remaining options are still applied when one fails.
+*
+* @param [in] socket
+*       Open socket or acceptor.
+*
+* @param [in] options
+*       Options to apply.
+*
+* @return
+*       Options that could not be applied, empty if all of them were, for the caller to log.
+*/
+template <typename Socket>
+inline std::vector<SocketOptionError> ApplySocketOptions(Socket& socket, const SocketOptions& options)
+{
+    std::vector<SocketOptionError> errors;
+
+    auto setOption = [&](const char* name, const auto& option)
+    {
+        boost::system::error_code ec;
+        socket.set_option(option, ec);
+        if (ec)
+            errors.push_back({ name, ec });
+    };
+
+    using boost::asio::detail::socket_option::boolean;
+    using boost::asio::detail::socket_option::integer;
+
+    if (options.NoDelay)
+        setOption("TCP_NODELAY", boost::asio::ip::tcp::no_delay(*options.NoDelay));
+
+    if (options.SendBufferSize)
+        setOption("SO_SNDBUF", boost::asio::socket_base::send_buffer_size(*options.SendBufferSize));
+
+    if (options.ReceiveBufferSize)
+        setOption("SO_RCVBUF", boost::asio::socket_base::receive_buffer_size(*options.ReceiveBufferSize));
+
+    if (options.NotSentLowWatermark)
+    {
+#if defined(TCP_NOTSENT_LOWAT)
+        setOption("TCP_NOTSENT_LOWAT", integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(*options.NotSentLowWatermark));
+#else
+        errors.push_back({ "TCP_NOTSENT_LOWAT", boost::asio::error::operation_not_supported });
+#endif
+    }
+
+    if (options.QuickAck)
+    {
+#if defined(TCP_QUICKACK)
+        setOption("TCP_QUICKACK", boolean<IPPROTO_TCP, TCP_QUICKACK>(*options.QuickAck));
+#else
+        errors.push_back({ "TCP_QUICKACK", boost::asio::error::operation_not_supported });
+#endif
+    }
+
+    if (options.KeepAlive)
+        setOption("SO_KEEPALIVE", boost::asio::socket_base::keep_alive(*options.KeepAlive));
+
+    if (options.KeepAliveIdle)
+    {
+        int seconds = static_cast<int>(options.KeepAliveIdle->count());
+#if defined(TCP_KEEPIDLE)
+        setOption("TCP_KEEPIDLE", integer<IPPROTO_TCP, TCP_KEEPIDLE>(seconds));
+#elif defined(TCP_KEEPALIVE)
+        // macOS names the idle time TCP_KEEPALIVE.
+        setOption("TCP_KEEPALIVE", integer<IPPROTO_TCP, TCP_KEEPALIVE>(seconds));
+#else
+        (void)seconds;
+        errors.push_back({ "TCP_KEEPIDLE", boost::asio::error::operation_not_supported });
+#endif
+    }
+
+    if (options.KeepAliveInterval)
+    {
+#if defined(TCP_KEEPINTVL)
+        setOption("TCP_KEEPINTVL", integer<IPPROTO_TCP, TCP_KEEPINTVL>(static_cast<int>(options.KeepAliveInterval->count())));
+#else
+        errors.push_back({ "TCP_KEEPINTVL", boost::asio::error::operation_not_supported });
+#endif
+    }
+
+    if (options.KeepAliveCount)
+    {
+#if defined(TCP_KEEPCNT)
+        setOption("TCP_KEEPCNT", integer<IPPROTO_TCP, TCP_KEEPCNT>(*options.KeepAliveCount));
+#else
+        errors.push_back({ "TCP_KEEPCNT", boost::asio::error::operation_not_supported });
+#endif
+    }
+
+    if (options.UserTimeout)
+    {
+#if defined(TCP_USER_TIMEOUT)
+        setOption("TCP_USER_TIMEOUT", integer<IPPROTO_TCP, TCP_USER_TIMEOUT>(static_cast<int>(options.UserTimeout->count())));
+#else
+        errors.push_back({ "TCP_USER_TIMEOUT", boost::asio::error::operation_not_supported });
+#endif
+    }
+
+    return errors;
+}
+
+END_NAMESPACE_NET
@@ -1,19 +1,30 @@
 #pragma once
 
 #include "Server.h"
+#include "OutboundQueue.h"
+#include "FrameAssembler.h"
+#include "ZeroCopySender.h"
+#include "TCPCommon/MirroredRingBuffer.h"
 #include <boost/asio.hpp>
+#include <optional>
 
 BEGIN_NAMESPACE_TCP
 
-class ClientHandler
+/**
+* Handles the socket of a single client connected to the Server.
+* 
+* The socket is created on a strand by the Server, so all of the asynchronous read/write handlers
+* of a client are serialized, even when the io_context is run from multiple threads.
+*/
+class ClientHandler : public std::enable_shared_from_this<ClientHandler>
 {
 public:
     ClientHandler(
         boost::asio::ip::tcp::socket socket, 
-        uint32_t id,
-        OnDataReceivedCallback cb_OnDataReceived,
-        OnDataReceivedErrorCallback cb_OnDataReceivedError,
-        OnClientDisconnectedCallback cb_OnClientDisconnected
+        ClientID id,
+        const ServerConfig& config,
+        const ClientHandlerCallbacks& callbacks,
+        ServerStats& stats
     );
 
     ClientHandler(const ClientHandler& rhs) = delete;
@@ -22,20 +33,51 @@ public:
     ~ClientHandler();
 
     /**
-    * Checks if the socket is still open or not,
+    * Checks if the socket is still open or not, can be called from any thread.
     * 
     * @return
-    *       True, if the socket is open, else false.
+    *       True, if the socket is open and was not closed by the client handler, else false.
     */
     bool IsConnected() const;
 
     /**
     * Add an asynchromnous task to read from this clien's socket.
+    * Can be called from any thread, the read is always started on the client's strand.
     */
     void ScheduleRead();
 
+    /**
+    * Stops reading from the socket, so that the kernel buffers fill up and TCP backpressure reaches the sender.
+    * A read that is already in flight still completes and is delivered. Can be called from any thread.
+    */
+    void PauseReading();
+
+    /**
+    * Resumes reading from the socket after PauseReading(). Can be called from any thread.
+    */
+    void ResumeReading();
+
+    /**
+    * Reports data of this client that the application has queued for processing, see ServerConfig::InboundHighWatermark.
+    * Can be called from any thread.
+    */
+    void ReportInboundQueued(std::size_t bytes);
+
+    /**
+    * Reports queued data of this client that the application has processed, see ServerConfig::InboundLowWatermark.
+    * Can be called from any thread.
+    */
+    void ReportInboundConsumed(std::size_t bytes);
+
+    /**
+    * Returns the data that the application has queued for this client and not processed yet.
+    */
+    std::size_t     GetInboundQueuedBytes() const { return m_InboundQueuedBytes; }
+
     /**
     * Synchrounous call to write data to the socket.
+    * Blocks till all the bytes are written, also when ServerConfig::UseSharedReadBuffers, ReadDrainMaxBytes or
+    * UseReceiveTimestamps make the socket non-blocking. An error is printed, and the rest of the bytes are not written.
     * 
     * @param [in] buffer
     *       Byte data to be written.
@@ -47,6 +89,8 @@ public:
 
     /**
     * Asynchrounous call to write data to the socket.
+    * Can be called from any thread. The data is added to the outbound queue of the client, and is written
+    * completely, in order with the other messages that are written with ScheduleWrite().
     * 
     * @param [in] buffer
     *       Byte data to be written.
@@ -56,6 +100,58 @@ public:
     */
     void ScheduleWrite(const std::vector<uint8_t>& buffer, std::size_t bytesToWrite);
 
+    /**
+    * Asynchrounous call to write a shared payload to the socket.
+    * Only a reference to the payload is queued, so the same payload can be sent to many clients without copying it.
+    * 
+    * @param [in] payload
+    *       Byte data to be written.
+    *
+    * @param [in] priority
+    *       Lane of the outbound queue, control messages go ahead of the bulk messages that are not being written yet.
+    */
+    void ScheduleWrite(const SharedPayload& payload, MessagePriority priority = MessagePriority::Bulk);
+
+    /**
+    * Asynchrounous call to write a shared payload to the socket, conflated by key.
+    * If a message with the same key is still queued and not being written yet, it is replaced by this one in its place,
+    * so a client that falls behind only gets the latest message of every key, in the order the keys were first queued.
+    * 
+    * @param [in] key
+    *       Conflation key of the message.
+    *
+    * @param [in] payload
+    *       Byte data to be written.
+    */
+    void ScheduleConflatedWrite(ConflationKey key, const SharedPayload& payload);
+
+    /**
+    * Asynchrounous call to write a shared payload to the socket, for broadcasts.
+    * The write handler holds no reference of the client, so fanning out to all the clients of a shard touches no
+    * reference count per client. The caller must keep the client alive till the handler has run, which
+    * ServerShard::ForEachClient() does for the clients it walks.
+    * 
+    * @param [in] payload
+    *       Byte data to be written.
+    *
+    * @param [in] priority
+    *       Lane of the outbound queue, see ScheduleWrite().
+    *
+    * @param [in] key
+    *       If set, the message is conflated by this key, see ScheduleConflatedWrite().
+    */
+    void ScheduleBroadcastWrite(const SharedPayload& payload, MessagePriority priority,
+        std::optional<ConflationKey> key = std::nullopt);
+
+    /**
+    * Asynchrounous call to send a file to the socket, in order with the messages that are written with ScheduleWrite().
+    * Can be called from any thread. The file does not count towards ServerConfig::MaxOutboundBytes.
+    * 
+    * @param [in] file
+    *       File to be sent.
+    */
+    void ScheduleSendFile(FileTransferSPtr file);
+
     /**
     * Helper function details basic stats about the client.
     */
@@ -63,6 +159,8 @@ public:
 
     /**
     * Returns the latest byte data that is read from the socket.
+    * When framing is used, the data is delivered as messages instead, see Server::OnMessage().
+    * With ServerConfig::UseSharedReadBuffers the buffer is only valid during the OnDataReceived() callback.
     */
     const std::vector<uint8_t>& GetReadBuffer() const { return m_ReadBuffer; }
 
@@ -71,10 +169,31 @@ public:
     */
     std::size_t     GetBytesRead() const { return m_BytesRead; }
 
+    /**
+    * Returns the time at which the kernel received the latest data that is read, see ServerConfig::UseReceiveTimestamps.
+    * During OnDataReceived() and OnMessage() this is the receive time of the data being delivered, for a message that
+    * arrived in multiple reads the one of its last part. The time of the read, where the kernel did not stamp the data.
+    */
+    ReceiveClock::time_point GetLastReceiveTimestamp() const { return m_LastReceiveTimestamp; }
+
+    /**
+    * Returns the index of the protocol of this client in ServerConfig::Protocols,
+    * NoProtocol if the server has no protocols or the protocol is not detected yet.
+    */
+    std::size_t     GetProtocolIndex() const { return m_ProtocolIndex; }
+
+    /* Returned by GetProtocolIndex() when no protocol is detected. */
+    static constexpr std::size_t NoProtocol = static_cast<std::size_t>(-1);
+
+    /**
+    * Returns the strand of the client, that runs all of its handlers.
+    */
+    boost::asio::any_io_executor GetExecutor() { return m_Socket.get_executor(); }
+
     /**
     * Returns the ID of this client that was assigned by the server.
     */
-    uint32_t        GetID() const { return m_ID; }
+    ClientID        GetID() const { return m_ID; }
 
     /**
     * Factory function to create an object of the class.
@@ -88,47 +207,362 @@ public:
     * @param [in] id
     *       ID that is assigned by the server to this client.
     * 
-    * @param [in] cb_OnDataReceived
-    *       Callback function, called when server receives any data from the client.
+    * @param [in] config
+    *       Settings of the server, e.g. the framing that is used for the data received from the client.
     * 
-    * @param [in] cb_OnDataReceivedError
-    *       Callback function, called when server receives any errorneous data from the client.
+    * @param [in] callbacks
+    *       Callback functions through which the client reports to the server, e.g. when data is received.
+    *       They are owned by the server and must outlive the client handler.
     * 
-    * @param [in] cb_OnClientDisconnected
-    *       Callback function, called when a client disconnects from the server.
+    * @param [in] stats
+    *       Statistics of the server, that the client handler updates. Must outlive the client handler.
     *
     */
     static ClientHandlerSPtr Create(
         boost::asio::ip::tcp::socket socket, 
-        uint32_t id,
-        OnDataReceivedCallback cb_OnDataReceived,
-        OnDataReceivedErrorCallback cb_OnDataReceivedError,
-        OnClientDisconnectedCallback cb_OnClientDisconnected
+        ClientID id,
+        const ServerConfig& config,
+        const ClientHandlerCallbacks& callbacks,
+        ServerStats& stats
     );
 
+private:
+
+    /**
+    * Starts the actual async_read_some on the socket, must be called on the client's strand.
+    */
+    void DoRead();
+
+    /**
+    * Returns true if reading is paused, either by PauseReading() or by the inbound watermarks.
+    * Must be called on the client's strand.
+    */
+    bool IsReadPaused() const { return m_IsReadPausedByUser || m_IsReadPausedByWatermark; }
+
+    /**
+    * Starts reading again, if reading is not paused anymore and stopped because it was. Must be called on the client's strand.
+    */
+    void RestartReading();
+
+    /**
+    * Pauses or resumes reading depending on the queued inbound data and the watermarks. Must be called on the client's strand.
+    */
+    void UpdateInboundFlowControl();
+
+    /**
+    * Result of draining the socket after a read, see DrainReads().
+    */
+    enum class ReadDrainResult
+    {
+        /* The socket has no more data, the next read waits for more. */
+        Drained,
+
+        /* The read budget ran out, the next read is posted so that the other clients get their turn first. */
+        BudgetExhausted,
+
+        /* The client disconnected or is errorneous, no more reads must be started. */
+        Stopped,
+    };
+
+    /**
+    * Keeps reading from the socket with non-blocking reads after a completed read, see ServerConfig::ReadDrainMaxBytes.
+    * 
+    * @param [in] bytesRead
+    *       Number of bytes of the read that just completed.
+    * 
+    * @param [in] bufferSize
+    *       Size of the buffer that the completed read used.
+    */
+    ReadDrainResult DrainReads(std::size_t bytesRead, std::size_t bufferSize);
+
+    /**
+    * Starts the next read depending on how the previous reads ended.
+    */
+    void ContinueReading(ReadDrainResult result);
+
+    /**
+    * Waits for the socket to become readable, then reads with a non-blocking read, see ReadSome().
+    * With ServerConfig::UseSharedReadBuffers the read goes into a buffer that is borrowed from the ReadBufferPool
+    * of the thread. Must be called on the client's strand.
+    */
+    void DoWaitForRead();
+
+    /**
+    * Non-blocking read from the socket, that also takes the receive timestamp when ServerConfig::UseReceiveTimestamps is set.
+    */
+    std::size_t ReadSome(boost::asio::mutable_buffer target, boost::system::error_code& ec);
+
+    /**
+    * Handles the result of a read from the socket and delivers the data to the server.
+    * 
+    * @return
+    *       True, if the client should keep reading, false if it disconnected or is errorneous.
+    */
+    bool OnReadCompleted(const boost::system::error_code& ec, std::size_t bytesRead);
+
+    /**
+    * Reports to the server that the client disconnected, with OnClientDisconnected() for eof and OnDataReceivedError()
+    * for any other error. Only the first call reports, e.g. closing the socket of a slow consumer also aborts its
+    * pending read, whose error must not report the same disconnection again.
+    */
+    void ReportDisconnected(const boost::system::error_code& ec);
+
+    /**
+    * Stops the connection from the strand, e.g. for a slow consumer, and cancels the pending operations so that their
+    * handlers let go of the client. The socket itself is only closed by the destructor, as the other threads may still
+    * use it through IsConnected() and Write().
+    */
+    void CloseSocket();
+
+    /**
+    * Delivers the bytes that were just read into 'm_ReadBuffer' to the server.
+    * 
+    * @return
+    *       False, if the data violates the framing and the client has been reported as errorneous.
+    */
+    bool OnDataRead(std::size_t bytesRead);
+
+    /**
+    * Delivers the first bytes of 'm_ReadBuffer' to the server, as raw data or as messages.
+    * 
+    * @return
+    *       False, if the data violates the framing and the client has been reported as errorneous.
+    */
+    bool DeliverReadData(std::size_t size);
+
+    /**
+    * Adds the bytes that were just read to the sniffed bytes, and tries to detect the protocol of the client from them.
+    * 
+    * @return
+    *       False, if no protocol matches and the client has been reported as errorneous.
+    */
+    bool SniffProtocol(std::size_t bytesRead);
+
+    /**
+    * Creates the frame assembler of the client, if the framing needs one.
+    */
+    void CreateFrameAssembler(const FramingOptions& framing);
+
+    /**
+    * Adds the bytes that were just read into 'm_ReadRing' to the buffered data, and delivers the complete messages.
+    * 
+    * @return
+    *       False, if the data violates the framing.
+    */
+    bool FeedReadRing(std::size_t bytesRead);
+
+    /**
+    * Returns the memory that the next read goes into, the free space of 'm_ReadRing' if it is used, else 'm_ReadBuffer'.
+    */
+    boost::asio::mutable_buffer GetReadTarget();
+
+    /**
+    * Returns the size of the read buffer that this client owns, for the stats.
+    */
+    std::size_t GetOwnedReadBufferSize() const { return m_ReadRing ? m_ReadRing->Capacity() : m_ReadBuffer.size(); }
+
+    /**
+    * Grows or shrinks 'm_ReadBuffer' depending on how much of it the recent reads used.
+    */
+    void AdaptReadBufferSize(std::size_t bytesRead);
+
+    /**
+    * Adds a message to the outbound queue, unless ServerConfig::MaxOutboundBytes rules it out, and starts writing it.
+    * A message with a conflation key replaces the queued message with the same key, see ScheduleConflatedWrite().
+    * Must be called on the client's strand.
+    */
+    void QueueWrite(const SharedPayload& payload, MessagePriority priority, std::optional<ConflationKey> key = std::nullopt);
+
+    /**
+    * Applies ServerConfig::OutboundLimitPolicy to a message that does not fit into the outbound queue.
+    *
+    * @param [in] key
+    *       Conflation key of the message, the queued message it replaces is not dropped to make room for it.
+    *
+    * @return
+    *       True, if the message should be queued anyway.
+    */
+    bool ApplyOutboundLimit(const SharedPayload& payload, std::optional<ConflationKey> key);
+
+    /**
+    * Reports the outbound watermarks that the queued data crossed, see ServerConfig::OutboundHighWatermark.
+    */
+    void UpdateOutboundWatermarks();
+
+    /**
+    * Counts bytes that entered or left the outbound queue in the statistics.
+    * Only done when ServerConfig::MaxOutboundBytes or the outbound watermarks are set, so the writes of a broadcast do
+    * not update a shared counter for nothing.
+    */
+    void CountOutboundQueued(std::size_t size);
+    void CountOutboundReleased(std::size_t size);
+
+    /**
+    * Starts writing the outbound queue after a message was queued, right away or coalesced with the messages that
+    * follow, see ServerConfig::CoalesceWrites. Control messages are never held back. Must be called on the client's strand.
+    */
+    void OnWriteQueued(MessagePriority priority);
+
+    /**
+    * Schedules the write of the coalesced messages, at the end of the current turn of the strand or after the
+    * coalescing delay. Must be called on the client's strand.
+    */
+    void ScheduleFlush();
+
+    /**
+    * Writes the coalesced messages, unless a write is already in flight. Must be called on the client's strand.
+    */
+    void Flush();
+
+    /**
+    * Writes all the messages of the outbound queue with a single gather write, or sends the next file of the queue.
+    * Must be called on the client's strand.
+    */
+    void DoWrite();
+
+    /**
+    * Handles a write that failed: releases the queued messages, aborts the queued files, reports the disconnection
+    * and stops the connection, so that the messages queued afterwards are not written to the dead socket one by one.
+    */
+    void OnWriteFailed(const boost::system::error_code& ec);
+
+    /**
+    * Sends a file that was taken from the outbound queue, then continues with the rest of the queue.
+    */
+    void DoSendFile(FileTransferSPtr file);
+
+    /**
+    * Writes the in-flight batch of the outbound queue with MSG_ZEROCOPY, see ServerConfig::ZeroCopyThreshold.
+    */
+    void DoZeroCopyWrite(std::span<const boost::asio::const_buffer> batch);
+
+    /**
+    * Waits for the kernel to complete the MSG_ZEROCOPY sends, while any of their payloads are held, and reaps the
+    * completions that are already there. Does not keep the client alive, the held payloads are released with the client.
+    */
+    void WaitForZeroCopyCompletions();
+
 private:
 
     /* Latest number of bytes that are read into the 'm_ReadBuffer'. */
     std::size_t                                 m_BytesRead;
 
-    /* Latest bytes that are read into from the socket. */
+    /* Bounds of the size of 'm_ReadBuffer'. */
+    const std::size_t                           m_ReadBufferMinSize;
+    const std::size_t                           m_ReadBufferMaxSize;
+
+    /* True if the read buffer is borrowed from the ReadBufferPool only while reading. */
+    const bool                                  m_UseSharedReadBuffers;
+
+    /* Budget of a single drain of the socket, see ServerConfig::ReadDrainMaxBytes. Draining is disabled if 0. */
+    const std::size_t                           m_ReadDrainMaxBytes;
+    const uint32_t                              m_ReadDrainMaxReads;
+
+    /* Latest bytes that are read into from the socket, empty between reads when 'm_UseSharedReadBuffers' is set. */
     std::vector<uint8_t>                        m_ReadBuffer;
 
+    /* True if the reads take the receive timestamps of the kernel, see ServerConfig::UseReceiveTimestamps. */
+    const bool                                  m_UseReceiveTimestamps;
+
+    /* Time at which the kernel received the latest data that is read, and false if the kernel did not stamp it and it is the time of the read. */
+    ReceiveClock::time_point                    m_LastReceiveTimestamp;
+    bool                                        m_IsLastReceiveTimestampFromKernel;
+
+    /* Ring buffer that framed reads go into instead of 'm_ReadBuffer', see ServerConfig::UseMirroredReadBuffer. */
+    std::unique_ptr<MirroredRingBuffer>         m_ReadRing;
+
+    /* Number of consecutive reads that filled 'm_ReadBuffer' completely. */
+    uint32_t                                    m_NumFullReads;
+
+    /* Number of consecutive reads that used less than a quarter of 'm_ReadBuffer'. */
+    uint32_t                                    m_NumSmallReads;
+
     /* boost::asio::ip::tcp::socket object that is handled by this class. */
     boost::asio::ip::tcp::socket                m_Socket;
 
+    /* True once the disconnection of the client was reported to the server. */
+    bool                                        m_IsDisconnected;
+
+    /* True once CloseSocket() stopped the connection, read by IsConnected() from any thread. */
+    std::atomic<bool>                           m_IsClosed;
+
+    /* Messages waiting to be written to the socket. */
+    OutboundQueue                               m_OutboundQueue;
+
+    /* True while a batch of the outbound queue is being written, only one write is in flight at a time. */
+    bool                                        m_WriteInProgress;
+
+    /* Settings of the write coalescing, see ServerConfig::CoalesceWrites. */
+    const bool                                  m_CoalesceWrites;
+    const std::chrono::microseconds             m_WriteCoalescingDelay;
+    const std::size_t                           m_WriteCoalescingMaxBytes;
+
+    /* Limit of the outbound queue and what happens when it is reached, see ServerConfig::MaxOutboundBytes. */
+    const std::size_t                           m_MaxOutboundBytes;
+    const SlowConsumerPolicy                    m_OutboundLimitPolicy;
+
+    /* Watermarks of the outbound queue, see ServerConfig::OutboundHighWatermark. */
+    const std::size_t                           m_OutboundHighWatermark;
+    const std::size_t                           m_OutboundLowWatermark;
+
+    /* True after the outbound queue went above the high watermark, till it drops to the low watermark. */
+    bool                                        m_IsAboveOutboundHighWatermark;
+
+    /* Sends the batches of at least 'm_ZeroCopyThreshold' bytes, nullptr if MSG_ZEROCOPY is not used. */
+    std::unique_ptr<ZeroCopySender>             m_ZeroCopySender;
+    const std::size_t                           m_ZeroCopyThreshold;
+
+    /* True while waiting for the completions of the MSG_ZEROCOPY sends. */
+    bool                                        m_IsWaitingForZeroCopyCompletions;
+
+    /* True while a flush of the coalesced messages is scheduled. */
+    bool                                        m_IsFlushScheduled;
+
+    /* Timer of the coalescing delay, nullptr if the coalesced messages are written at the end of the strand's turn. */
+    std::unique_ptr<boost::asio::steady_timer>  m_FlushTimer;
+
     /* ID that is assigned to this client by the server. */
-    const uint32_t                              m_ID;
+    const ClientID                              m_ID;
+
+    /* Callbacks through which this client reports to the server. */
+    const ClientHandlerCallbacks&               m_Callbacks;
+
+    /* Statistics of the server. */
+    ServerStats&                                m_Stats;
+
+    /* Shard of the client, the per shard counters of m_Stats that it updates. */
+    const uint32_t                              m_ShardIndex;
+
+    /* True while a read is in flight or about to be started, false once reading stopped because it is paused. */
+    bool                                        m_IsReading;
+
+    /* Reading is paused by PauseReading(). */
+    bool                                        m_IsReadPausedByUser;
+
+    /* Reading is paused because the queued inbound data went above the high watermark. */
+    bool                                        m_IsReadPausedByWatermark;
+
+    /* Watermarks of the inbound flow control, see ServerConfig::InboundHighWatermark. */
+    const std::size_t                           m_InboundHighWatermark;
+    const std::size_t                           m_InboundLowWatermark;
+
+    /* Data that the application has queued for this client and not processed yet. */
+    std::atomic<std::size_t>                    m_InboundQueuedBytes;
+
+    /* Protocols that the server detects, owned by the server. */
+    const std::vector<ProtocolOptions>&         m_Protocols;
+
+    /* Index of the protocol of this client in 'm_Protocols', NoProtocol if not detected. */
+    std::size_t                                 m_ProtocolIndex;
 
-    /* Callbacks */
-    /* This callback will be called after the server receives data from the client. */
-    OnDataReceivedCallback m_OnDataReceivedCallback;
+    /* Number of bytes at the start of 'm_ReadBuffer' that were sniffed so far, while the protocol is not detected yet. */
+    std::size_t                                 m_SniffedBytes;
 
-    /* This callback will be called if we receive any errorneous data from the client. */
-    OnDataReceivedErrorCallback m_OnDataReceivedErrorCallback;
+    /* True while the protocol of the client is being detected. */
+    bool                                        m_IsSniffing;
 
-    /* This callback will be called when the client disconnects. */
-    OnClientDisconnectedCallback m_OnClientDisconnectedCallback;
+    /* Splits the received data into messages, nullptr if the server does not use framing. */
+    std::unique_ptr<FrameAssembler>             m_FrameAssembler;
 
 };
 
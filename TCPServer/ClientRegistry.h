@@ -0,0 +1,128 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+
+BEGIN_NAMESPACE_TCP
+
+/**
+* Registry of the clients of a ServerShard, implemented as a generation-checked slot map.
+*
+* A ClientID is made of three parts:
+*       [ shard index : 8 bits ][ generation : 24 bits ][ slot index : 32 bits ]
+*
+* Looking up a client indexes the slot directly and compares the generation, so there is no hashing,
+* and an ID of a client that has already disconnected is rejected even if its slot has been reused.
+* The clients themselves are kept densely packed in one contiguous array, which is what broadcasts iterate.
+*
+* This class is not thread safe, the owner is responsible for locking.
+*/
+class ClientRegistry
+{
+public:
+
+    /* Number of bits of a ClientID that hold the slot index. */
+    static constexpr uint32_t IndexBits = 32;
+
+    /* Number of bits of a ClientID that hold the generation of the slot. */
+    static constexpr uint32_t GenerationBits = 24;
+
+    /* Position of the shard index inside a ClientID. */
+    static constexpr uint32_t ShardShift = IndexBits + GenerationBits;
+
+    /**
+    * @param [in] shardIndex
+    *       Index of the shard that owns this registry, it is encoded into every ClientID.
+    */
+    explicit ClientRegistry(uint32_t shardIndex);
+
+    /**
+    * Adds a new client to the registry.
+    *
+    * @param [in] createClient
+    *       Called with the ID that is assigned to the new client, returns the client handler to store.
+    *
+    * @return
+    *       ID of the newly added client.
+    */
+    ClientID Insert(const std::function<ClientHandlerSPtr(ClientID)>& createClient);
+
+    /**
+    * Removes a client from the registry.
+    *
+    * @return
+    *       The removed client, nullptr if the ID did not refer to a live client.
+    */
+    ClientHandlerSPtr Remove(ClientID ID);
+
+    /**
+    * Returns a pointer to the client with the given ID, nullptr if the ID is stale or invalid.
+    * The pointer is only valid till the registry is modified.
+    */
+    const ClientHandlerSPtr* Find(ClientID ID) const;
+
+    /**
+    * Returns the densely packed clients, in no particular order.
+    */
+    const std::vector<ClientHandlerSPtr>& GetClients() const { return m_Clients; }
+
+    /**
+    * Returns the IDs of the clients, GetIDs()[i] is the ID of GetClients()[i].
+    */
+    const std::vector<ClientID>& GetIDs() const { return m_IDs; }
+
+    /**
+    * Returns the number of clients in the registry.
+    */
+    std::size_t Size() const { return m_Clients.size(); }
+
+    /**
+    * Returns the number of slots, used or free.
+    */
+    std::size_t GetNumSlots() const { return m_Slots.size(); }
+
+    /**
+    * Returns the index of the shard that owns the client with the given ID.
+    */
+    static uint32_t GetShardIndex(ClientID ID) { return static_cast<uint32_t>(ID >> ShardShift); }
+
+    /**
+    * Returns the index of the slot of the client with the given ID.
+    */
+    static uint32_t GetSlotIndex(ClientID ID) { return static_cast<uint32_t>(ID & ((ClientID(1) << IndexBits) - 1)); }
+
+private:
+
+    struct Slot
+    {
+        /* Generation of the slot, bumped every time the client of the slot is removed. */
+        uint32_t Generation;
+
+        /* Index of the client in m_Clients, InvalidIndex if the slot is free. */
+        uint32_t DenseIndex;
+    };
+
+    static constexpr uint32_t InvalidIndex = static_cast<uint32_t>(-1);
+
+    static uint32_t GetGeneration(ClientID ID) { return static_cast<uint32_t>((ID >> IndexBits) & ((ClientID(1) << GenerationBits) - 1)); }
+
+    ClientID MakeID(uint32_t slotIndex, uint32_t generation) const;
+
+private:
+
+    /* Index of the shard that owns this registry. */
+    const uint32_t                  m_ShardIndex;
+
+    /* Slots, indexed by the slot index of a ClientID. */
+    std::vector<Slot>               m_Slots;
+
+    /* Indices of the slots that are free to be reused. */
+    std::vector<uint32_t>           m_FreeSlots;
+
+    /* Densely packed clients. */
+    std::vector<ClientHandlerSPtr>  m_Clients;
+
+    /* IDs of the densely packed clients. */
+    std::vector<ClientID>           m_IDs;
+};
+
+END_NAMESPACE_TCP
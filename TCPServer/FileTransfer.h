@@ -0,0 +1,157 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include "TCPCommon/HandlerAllocator.h"
+#include <boost/asio.hpp>
+
+BEGIN_NAMESPACE_TCP
+
+class FileTransfer;
+using FileTransferSPtr = std::shared_ptr<FileTransfer>;
+
+/* Called on the client's strand once a file is sent, or failed to be sent, with the number of bytes that were sent. */
+using OnFileSentCallback = std::function<void(const boost::system::error_code&, uint64_t)>;
+
+/**
+* A range of a file that is sent to a client from its outbound queue, see Server::SendFile().
+*
+* The bytes go from the file to the socket inside the kernel, with sendfile() on Linux and TransmitFile() on Windows,
+* so they are never copied into the process. Elsewhere the file is read and written in chunks through a single buffer.
+* The completion callback is always called exactly once on the client's strand, with operation_aborted if the transfer
+* never got to run. Only a transfer that is still queued when its client is destroyed, e.g. because the server stops,
+* calls it from the thread that destroys it.
+*/
+class FileTransfer : public std::enable_shared_from_this<FileTransfer>
+{
+public:
+
+#if defined(_WIN32)
+    using NativeHandle = HANDLE;
+#else
+    using NativeHandle = int;
+#endif
+
+    /* Called by AsyncSend() once the whole range is sent or sending failed. */
+    using SendHandler = RecyclingFunction<void(const boost::system::error_code&)>;
+
+    FileTransfer(const FileTransfer&) = delete;
+    FileTransfer& operator=(const FileTransfer&) = delete;
+
+    ~FileTransfer();
+
+    /**
+    * Opens a file to send.
+    *
+    * @param [in] path
+    *       Path of the file.
+    *
+    * @param [in] offset
+    *       Offset in the file of the first byte to send.
+    *
+    * @param [in] length
+    *       Number of bytes to send, 0 to send everything from 'offset' to the end of the file.
+    *
+    * @param [in] onSent
+    *       Called once the file is sent, may be empty.
+    *
+    * @return
+    *       nullptr, if the file could not be opened or the range is not inside the file.
+    */
+    static FileTransferSPtr Open(const std::string& path, uint64_t offset, uint64_t length, OnFileSentCallback onSent);
+
+    /**
+    * Sends from a file that is already open. The handle is not closed, it must stay open till 'onSent' is called.
+    * On Windows the handle must not be opened with FILE_FLAG_OVERLAPPED.
+    *
+    * @params [in] file
+    *       Handle of the file.
+    *
+    * @params [in] offset, length, onSent
+    *       As in Open().
+    */
+    static FileTransferSPtr FromNativeHandle(NativeHandle file, uint64_t offset, uint64_t length, OnFileSentCallback onSent);
+
+    /**
+    * Starts sending the range to the socket, must be called on the socket's strand and only once.
+    * The completion callback of the transfer is called first, then 'handler', which is posted to the socket's executor
+    * and so never called before AsyncSend() returns. The transfer keeps itself alive till then, the socket must too.
+    */
+    void AsyncSend(boost::asio::ip::tcp::socket& socket, SendHandler handler);
+
+    /**
+    * Calls the completion callback of the transfer.
+    */
+    void Complete(const boost::system::error_code& ec);
+
+    /**
+    * Returns the number of bytes that are left to send.
+    */
+    uint64_t GetRemainingBytes() const { return m_Remaining; }
+
+    /**
+    * Returns the number of bytes that were sent.
+    */
+    uint64_t GetBytesSent() const { return m_BytesSent; }
+
+private:
+
+    FileTransfer(NativeHandle file, bool ownsFile, uint64_t offset, uint64_t length, OnFileSentCallback onSent);
+
+    /**
+    * Resolves a length of 0 to the rest of the file and checks that the range is inside the file.
+    *
+    * @return
+    *       nullptr, if the range is not inside the file. The handle is closed in that case if the transfer owns it.
+    */
+    static FileTransferSPtr Create(NativeHandle file, bool ownsFile, uint64_t offset, uint64_t length, OnFileSentCallback onSent);
+
+    /**
+    * Sends the next part of the range, till the socket would block, and continues asynchronously from there.
+    */
+    void SendNext(boost::asio::ip::tcp::socket& socket);
+
+    /**
+    * Accounts for bytes that were sent.
+    */
+    void Advance(std::size_t bytesSent);
+
+    /**
+    * Calls the completion callback, and posts the send handler of AsyncSend().
+    */
+    void Finish(boost::asio::ip::tcp::socket& socket, const boost::system::error_code& ec);
+
+    /**
+    * Returns the size of the file, or -1 if it is not known.
+    */
+    static int64_t GetFileSize(NativeHandle file);
+
+    static void CloseFile(NativeHandle file);
+
+private:
+
+    /* Handle of the file. */
+    NativeHandle        m_File;
+
+    /* True if the handle is closed with the transfer. */
+    const bool          m_OwnsFile;
+
+    /* Offset in the file of the next byte to send. */
+    uint64_t            m_Offset;
+
+    /* Number of bytes that are left to send. */
+    uint64_t            m_Remaining;
+
+    /* Number of bytes that were sent. */
+    uint64_t            m_BytesSent;
+
+    /* Completion callback of the user, empty once called. */
+    OnFileSentCallback  m_OnSent;
+
+    /* Handler of AsyncSend(), empty when no send is in progress. */
+    SendHandler         m_SendHandler;
+
+    /* Chunk of the file that is being written, only used where the kernel cannot send from the file directly. */
+    std::vector<uint8_t> m_ChunkBuffer;
+};
+
+END_NAMESPACE_TCP
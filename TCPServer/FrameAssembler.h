@@ -0,0 +1,213 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include "TCPCommon/Framing.h"
+#include "TCPCommon/DelimiterScanner.h"
+#include "TCPCommon/MirroredRingBuffer.h"
+#include <span>
+
+BEGIN_NAMESPACE_TCP
+
+using OnFrameCallback = std::function<void(std::span<const uint8_t>)>;
+
+/**
+* Callbacks through which a FrameAssembler delivers the messages that are larger than FramingOptions::StreamingThreshold.
+*/
+struct FrameStreamCallbacks
+{
+    /* Called when a streamed message starts, with its size. */
+    std::function<void(uint64_t)>                   OnBegin;
+
+    /* Called with the next bytes of the message, the span is only valid during the call. */
+    std::function<void(std::span<const uint8_t>)>   OnChunk;
+
+    /* Called after the last chunk of the message. */
+    std::function<void()>                           OnEnd;
+};
+
+/**
+* Splits the byte stream of a connection into messages, according to its FramingOptions.
+*
+* Frames that sit completely inside a chunk that is fed are delivered straight from that chunk, without being copied.
+* Only a frame that is split across chunks is reassembled in a per-connection buffer, which grows as needed.
+* In FramingMode::Delimited the messages are delivered without their delimiter.
+* In FramingMode::LengthPrefixed, messages larger than FramingOptions::StreamingThreshold are streamed in chunks
+* as they arrive instead, so the memory of a connection stays bounded however large its messages are.
+*/
+class FrameAssembler
+{
+public:
+
+    /**
+    * @param [in] options
+    *       Framing settings of the connection.
+    *
+    * @param [in] onFrame
+    *       Called with every complete message. The span is only valid during the call.
+    *
+    * @param [in] streamCallbacks
+    *       Called with the messages that are streamed, see FramingOptions::StreamingThreshold.
+    */
+    FrameAssembler(const FramingOptions& options, OnFrameCallback onFrame, FrameStreamCallbacks streamCallbacks = {});
+
+    FrameAssembler(const FrameAssembler&) = delete;
+    FrameAssembler(FrameAssembler&&) = delete;
+
+    /**
+    * Feeds the next chunk of the byte stream. Any number of messages may be delivered from a single chunk.
+    *
+    * @param [in] data
+    *       Bytes that were read from the connection.
+    *
+    * @return
+    *       False, if the stream violates the framing, e.g. a message is larger than FramingOptions::MaxFrameSize.
+    *       The connection should be closed in this case.
+    */
+    bool Feed(std::span<const uint8_t> data);
+
+    /**
+    * Delivers the complete messages at the start of 'data' straight from it, without keeping the rest.
+    * Used when the caller buffers the byte stream itself, e.g. in a MirroredRingBuffer, and feeds the unconsumed
+    * bytes again together with the next chunk. Must only be used while HasPartialFrame() is false.
+    *
+    * @param [in] data
+    *       Bytes of the connection that are not consumed yet.
+    *
+    * @return
+    *       Number of bytes consumed from 'data', or -1 if the stream violates the framing.
+    */
+    std::ptrdiff_t Parse(std::span<const uint8_t> data);
+
+    /**
+    * Delivers the messages in the buffered data of a ring buffer that the byte stream is read into, and consumes
+    * their bytes from it. Complete frames are parsed in place. Only the bytes of a streamed frame, or of a frame
+    * larger than the ring buffer, are handed to the assembler, and the frames after it are parsed in place again.
+    *
+    * @param [in] ring
+    *       Ring buffer that the last read was committed to.
+    *
+    * @return
+    *       False, if the stream violates the framing. The connection should be closed in this case.
+    */
+    bool FeedRing(MirroredRingBuffer& ring);
+
+    /**
+    * Returns true while a frame that was split across the chunks given to Feed() is being reassembled or streamed.
+    */
+    bool HasPartialFrame() const { return !m_Buffer.empty() || m_StreamRemaining; }
+
+    /**
+    * Returns the framing settings of the connection.
+    */
+    const FramingOptions& GetOptions() const { return m_Options; }
+
+private:
+
+    /* Capacity of m_Buffer that is kept after a reassembled frame is delivered, larger buffers are released. */
+    static constexpr std::size_t RetainedBufferCapacity = 64 * 1024;
+
+    /**
+    * Returns a copy of the options with an empty delimiter replaced by CRLF.
+    */
+    static FramingOptions ValidateOptions(const FramingOptions& options);
+
+    /**
+    * Feeds a chunk in FramingMode::LengthPrefixed.
+    */
+    bool FeedLengthPrefixed(std::span<const uint8_t> data);
+
+    /**
+    * Feeds a chunk in FramingMode::Delimited.
+    */
+    bool FeedDelimited(std::span<const uint8_t> data);
+
+    /**
+    * Delivers the next bytes of the message that is being streamed.
+    *
+    * @return
+    *       Number of bytes consumed from 'data'.
+    */
+    std::ptrdiff_t FeedStream(std::span<const uint8_t> data);
+
+    /**
+    * Starts streaming a message of the given length.
+    */
+    void BeginStream(uint64_t length);
+
+    /**
+    * Delivers the complete frames at the start of 'data' in FramingMode::LengthPrefixed, see Parse().
+    * Stops after the prefix of a frame that is streamed.
+    */
+    std::ptrdiff_t ParseLengthPrefixed(std::span<const uint8_t> data);
+
+    /**
+    * Delivers the complete lines at the start of 'data' in FramingMode::Delimited, see Parse().
+    */
+    std::ptrdiff_t ParseDelimited(std::span<const uint8_t> data);
+
+    /**
+    * Returns the length of the end of m_Buffer that, together with the start of 'data', forms the delimiter.
+    * 0 if the delimiter does not straddle the two.
+    */
+    std::size_t FindStraddlingDelimiter(std::span<const uint8_t> data) const;
+
+    /**
+    * Feeds bytes to the frame that is being reassembled in m_Buffer.
+    *
+    * @return
+    *       Number of bytes consumed from 'data', or -1 if the stream violates the framing.
+    */
+    std::ptrdiff_t FeedPartialFrame(std::span<const uint8_t> data);
+
+    /**
+    * Feeds bytes to the line that is being reassembled in m_Buffer.
+    *
+    * @return
+    *       Number of bytes consumed from 'data', up to the end of the delimiter, or -1 if the line is too long.
+    */
+    std::ptrdiff_t FeedPartialLine(std::span<const uint8_t> data);
+
+    /**
+    * Feeds only the bytes that finish the frame which is being reassembled or streamed, see HasPartialFrame().
+    *
+    * @return
+    *       Number of bytes consumed from 'data', or -1 if the stream violates the framing.
+    */
+    std::ptrdiff_t FinishPartialFrame(std::span<const uint8_t> data);
+
+    /**
+    * Checks if a frame of the given length is streamed instead of being delivered at once.
+    */
+    bool IsStreamedFrameLength(uint64_t length) const { return m_Options.StreamingThreshold && length > m_Options.StreamingThreshold; }
+
+private:
+
+    /* Framing settings of the connection. */
+    FramingOptions          m_Options;
+
+    /* Called with every complete message. */
+    OnFrameCallback         m_OnFrame;
+
+    /* Called with the messages that are streamed. */
+    FrameStreamCallbacks    m_StreamCallbacks;
+
+    /* Finds the delimiter of m_Options, used in FramingMode::Delimited. */
+    DelimiterScanner        m_DelimiterScanner;
+
+    /* Bytes of a frame that was split across chunks, including its prefix in FramingMode::LengthPrefixed. */
+    std::vector<uint8_t>    m_Buffer;
+
+    /* Size of the frame in m_Buffer including its prefix, 0 while its prefix is not complete yet. */
+    std::size_t             m_PartialFrameSize;
+
+    /* Size of the prefix of the frame in m_Buffer, 0 while the prefix is not complete yet. */
+    std::size_t             m_PartialPrefixSize;
+
+    /* Number of bytes at the start of the data given to the next Parse() that are known not to hold a delimiter. */
+    std::size_t             m_ParseScanOffset;
+
+    /* Number of bytes of the message that is being streamed that have not arrived yet, 0 if none is streamed. */
+    uint64_t                m_StreamRemaining;
+};
+
+END_NAMESPACE_TCP
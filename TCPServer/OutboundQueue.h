@@ -0,0 +1,251 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include "TCPCommon/SharedPayload.h"
+#include "FileTransfer.h"
+#include "ServerConfig.h"
+#include <boost/asio/buffer.hpp>
+#include <deque>
+#include <optional>
+#include <vector>
+#include <span>
+#include <unordered_map>
+
+BEGIN_NAMESPACE_TCP
+
+/**
+* Queue of the messages that are waiting to be written to a client.
+*
+* Messages are written in batches: all the queued messages are moved into the in-flight batch at once,
+* and written with a single scatter/gather write. Messages that are queued while a batch is in flight
+* wait for the next batch, so whole messages are always written in the order they were queued.
+* Files are queued in between the messages, and sent on their own once the messages before them are written.
+*
+* There are two lanes, see MessagePriority. Every batch starts with all the queued control messages, followed by
+* the bulk messages up to the next file and to the bulk limit of a batch, so a control message only ever waits
+* for the batch in flight.
+*
+* This class is not thread safe, it is only used from the strand of its ClientHandler.
+*/
+class OutboundQueue
+{
+public:
+
+    /**
+    * @param [in] bulkBatchMaxBytes
+    *       Limit of the bulk messages of a batch, see ServerConfig::BulkBatchMaxBytes.
+    */
+    explicit OutboundQueue(std::size_t bulkBatchMaxBytes = 0);
+
+    /**
+    * Adds a message to the back of its lane. Only a reference to the payload is kept, the bytes are not copied.
+    *
+    * @param [in] message
+    *       Byte data to be written.
+    *
+    * @param [in] priority
+    *       Lane of the message.
+    */
+    void Push(const SharedPayload& message, MessagePriority priority = MessagePriority::Bulk);
+
+    /**
+    * Adds a message to the bulk lane, or replaces the queued message with the same key in its place, so the order
+    * of the keys is kept. A message of the key that is already in flight is not replaced, the new one is queued.
+    *
+    * @param [in] message
+    *       Byte data to be written.
+    *
+    * @param [in] key
+    *       Conflation key of the message.
+    *
+    * @return
+    *       The message that was replaced, empty if there was none.
+    */
+    SharedPayload PushConflated(const SharedPayload& message, ConflationKey key);
+
+    /**
+    * Returns the size of the queued message with the given key, 0 if there is none.
+    */
+    std::size_t GetConflatedSize(ConflationKey key) const;
+
+    /**
+    * Adds a file to the back of the bulk lane, it is sent after the bulk messages that are queued before it.
+    *
+    * @param [in] file
+    *       File to be sent.
+    */
+    void PushFile(FileTransferSPtr file);
+
+    /**
+    * Returns true if the next thing to write is a file, which is taken with PopFile() instead of PrepareBatch().
+    * The control messages go first, but once the file is taken it is sent as a whole before the next batch.
+    */
+    bool IsFileNext() const { return m_Control.empty() && !m_Files.empty() && m_Files.front().Position == 0; }
+
+    /**
+    * Removes the next file from the queue, IsFileNext() must be true.
+    */
+    FileTransferSPtr PopFile();
+
+    /**
+    * Removes all the files from the queue, e.g. to abort them when the client disconnects.
+    */
+    std::vector<FileTransferSPtr> TakeFiles();
+
+    /**
+    * Moves the queued control messages, and the bulk messages up to the next file and the bulk limit, into the in-flight batch.
+    *
+    * @return
+    *       Buffers of the in-flight batch, valid till CompleteBatch() is called.
+    */
+    std::span<const boost::asio::const_buffer> PrepareBatch();
+
+    /**
+    * Releases the messages of the in-flight batch, after the batch has been written.
+    */
+    void CompleteBatch();
+
+    /**
+    * Ends the in-flight batch like CompleteBatch(), but hands its messages over instead of releasing them.
+    *
+    * @param [in] spare
+    *       Empty vector that takes the place of the in-flight batch, so that the queue keeps a capacity to batch into.
+    *
+    * @return
+    *       Messages of the in-flight batch.
+    */
+    std::vector<SharedPayload> TakeBatch(std::vector<SharedPayload>&& spare);
+
+    /**
+    * Drops the oldest bulk messages that are waiting for the next batch.
+    * The control messages and the in-flight batch are never touched.
+    *
+    * @param [in] bytesToFree
+    *       Number of bytes to free, the messages are dropped whole, so more may be freed.
+    *
+    * @param [in] keep
+    *       If set, the queued message of this conflation key is kept, e.g. because it is about to be replaced.
+    *       It moves ahead of the remaining messages if the messages before it are dropped.
+    *
+    * @return
+    *       Number of messages dropped.
+    */
+    std::size_t DropOldest(std::size_t bytesToFree, std::optional<ConflationKey> keep = std::nullopt);
+
+    /**
+    * Releases all the messages that are waiting for the next batch, e.g. when the socket failed and they are never written.
+    * The in-flight batch and the files are not touched.
+    */
+    void ClearMessages();
+
+    /**
+    * Returns true if there are no messages or files waiting to be written.
+    */
+    bool IsEmpty() const { return m_Control.empty() && GetNumPending() == 0 && m_Files.empty(); }
+
+    /**
+    * Returns the number of bytes waiting to be written, excluding the in-flight batch and the files.
+    */
+    std::size_t GetQueuedBytes() const { return m_QueuedBytes; }
+
+    /**
+    * Returns the number of bytes of the in-flight batch.
+    */
+    std::size_t GetInFlightBytes() const { return m_InFlightBytes; }
+
+    /**
+    * Returns the number of bytes held by the queue, waiting or in flight.
+    */
+    std::size_t GetTotalBytes() const { return m_QueuedBytes + m_InFlightBytes; }
+
+private:
+
+    /**
+    * Returns the number of bulk messages waiting for the next batch.
+    */
+    std::size_t GetNumPending() const { return m_Pending.size() - m_PendingHead; }
+
+    /**
+    * Returns the bulk message at the given index, counted from the first one that is waiting.
+    */
+    SharedPayload& GetPending(std::size_t index) { return m_Pending[m_PendingHead + index]; }
+    const SharedPayload& GetPending(std::size_t index) const { return m_Pending[m_PendingHead + index]; }
+
+    /**
+    * Takes the given number of bulk messages off the front of m_Pending, releasing what is left of them.
+    * Only the head index moves, the slots are erased once they are the larger half of m_Pending, so taking messages
+    * off the front of a long backlog does not move the rest of it every time.
+    */
+    void PopPendingFront(std::size_t numMessages);
+
+    /**
+    * Forgets the conflation keys of the bulk messages that left the front of m_Pending.
+    *
+    * @param [in] numMessages
+    *       Number of messages that were removed from the front of m_Pending.
+    */
+    void OnPendingRemoved(std::size_t numMessages);
+
+    /**
+    * Forgets the conflation keys of the bulk messages before the given sequence number.
+    */
+    void ForgetConflatedBefore(uint64_t sequence);
+
+    /**
+    * Returns the index in m_Pending of the queued message with the given key, or -1 if there is none.
+    */
+    std::ptrdiff_t FindConflated(ConflationKey key) const;
+
+    /**
+    * A file in the queue.
+    */
+    struct QueuedFile
+    {
+        /* Number of bulk messages in m_Pending that are written before the file. */
+        std::size_t         Position;
+
+        FileTransferSPtr    File;
+    };
+
+    /* Files waiting to be sent, in order. */
+    std::deque<QueuedFile>                  m_Files;
+
+    /* Control messages waiting for the next batch. */
+    std::vector<SharedPayload>              m_Control;
+
+    /*
+    * Bulk messages waiting for the next batch from m_PendingHead on, swapped with m_InFlight so that both keep their
+    * capacity. The slots before m_PendingHead belong to messages that already left the queue, and are empty.
+    */
+    std::vector<SharedPayload>              m_Pending;
+    std::size_t                             m_PendingHead = 0;
+
+    /* Messages of the batch that is currently being written. */
+    std::vector<SharedPayload>              m_InFlight;
+
+    /* Buffers pointing into m_InFlight, handed to the gather write. */
+    std::vector<boost::asio::const_buffer>  m_InFlightBuffers;
+
+    /*
+    * Sequence numbers of the queued conflated messages by key. A bulk message's sequence number is its index after
+    * m_PendingHead plus m_PendingBase, so it stays valid while the messages in front of it are taken out.
+    */
+    std::unordered_map<ConflationKey, uint64_t> m_ConflatedMessages;
+
+    /* Sequence numbers and keys of the queued conflated messages, in order, so their keys are forgotten as they leave. */
+    std::deque<std::pair<uint64_t, ConflationKey>> m_ConflatedOrder;
+
+    /* Number of bulk messages that have left the front of m_Pending. */
+    uint64_t                                m_PendingBase = 0;
+
+    /* Limit of the bulk messages of a batch, unlimited when 0. */
+    const std::size_t                       m_BulkBatchMaxBytes;
+
+    /* Total size of the messages in m_Control and m_Pending. */
+    std::size_t                             m_QueuedBytes = 0;
+
+    /* Total size of the messages in m_InFlight. */
+    std::size_t                             m_InFlightBytes = 0;
+};
+
+END_NAMESPACE_TCP
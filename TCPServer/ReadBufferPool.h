@@ -0,0 +1,42 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+
+BEGIN_NAMESPACE_TCP
+
+/**
+* Per-thread pool of read buffers.
+*
+* Used by clients that only borrow a read buffer once their socket is readable, see ServerConfig::UseSharedReadBuffers.
+* A buffer is borrowed and returned within a single completion handler, so one pool per thread is enough and
+* no locking is needed. An idle connection then holds no read buffer at all.
+*/
+class ReadBufferPool
+{
+public:
+
+    /**
+    * Returns the pool of the calling thread.
+    */
+    static ReadBufferPool& ForThisThread();
+
+    /**
+    * Borrows a buffer of at least the given size from the pool, allocating one if none is free.
+    */
+    std::vector<uint8_t> Acquire(std::size_t size);
+
+    /**
+    * Returns a buffer to the pool. Buffers beyond the pool's capacity are freed.
+    */
+    void Release(std::vector<uint8_t>&& buffer);
+
+private:
+
+    /* Maximum number of free buffers kept by a pool. */
+    static constexpr std::size_t MaxFreeBuffers = 4;
+
+    /* Buffers that are free to be borrowed. */
+    std::vector<std::vector<uint8_t>>   m_FreeBuffers;
+};
+
+END_NAMESPACE_TCP
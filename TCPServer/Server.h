@@ -1,15 +1,63 @@
 #pragma once
 
 #include "TCPCommon/Common.h"
+#include "TCPCommon/SharedPayload.h"
+#include "TCPCommon/ReceiveTimestamp.h"
+#include "ServerConfig.h"
+#include "ServerShard.h"
+#include "ServerStats.h"
+#include "FileTransfer.h"
 #include <boost/asio.hpp>
+#include <atomic>
+#include <optional>
+#include <span>
 
 namespace net { class IOBuffer; }
 
 BEGIN_NAMESPACE_TCP
 
-using OnDataReceivedCallback = std::function<void(ClientID)>;
+using OnDataReceivedCallback = std::function<void(ClientHandler&, std::span<const uint8_t>)>;
 using OnClientDisconnectedCallback = std::function<void(ClientID)>;
 using OnDataReceivedErrorCallback = std::function<void(ClientID, const boost::system::error_code&)>;
+using OnMessageCallback = std::function<void(ClientID, std::span<const uint8_t>)>;
+using OnMessageBeginCallback = std::function<void(ClientID, uint64_t)>;
+using OnMessageEndCallback = std::function<void(ClientID)>;
+using OnProtocolDetectedCallback = std::function<bool(ClientID, std::size_t)>;
+using OnOutboundQueueCallback = std::function<void(ClientID, std::size_t)>;
+
+/**
+* Callbacks through which a ClientHandler reports to the Server.
+* The Server owns a single instance, that is shared by all of its ClientHandlers.
+*/
+struct ClientHandlerCallbacks
+{
+    /* Called with the bytes received from the client, when no framing is used. */
+    OnDataReceivedCallback          OnDataReceived;
+
+    /* Called if we receive any errorneous data from the client. */
+    OnDataReceivedErrorCallback     OnDataReceivedError;
+
+    /* Called when the client disconnects. */
+    OnClientDisconnectedCallback    OnClientDisconnected;
+
+    /* Called with every complete message, when framing is used. */
+    OnMessageCallback               OnMessage;
+
+    /* Called for the messages that are streamed, see FramingOptions::StreamingThreshold. */
+    OnMessageBeginCallback          OnMessageBegin;
+    OnMessageCallback               OnMessageChunk;
+    OnMessageEndCallback            OnMessageEnd;
+
+    /* Called when the protocol of a client is detected, see ServerConfig::Protocols. */
+    OnProtocolDetectedCallback      OnProtocolDetected;
+
+    /* Called when the outbound queue of a client reaches its limit, see ServerConfig::MaxOutboundBytes. */
+    OnOutboundQueueCallback         OnClientBackpressure;
+
+    /* Called when the outbound queue of a client crosses a watermark, see ServerConfig::OutboundHighWatermark. */
+    OnOutboundQueueCallback         OnOutboundHighWatermark;
+    OnOutboundQueueCallback         OnOutboundLowWatermark;
+};
 
 /**
 * This class gives a basic implementation of a TCP Server.
@@ -23,12 +71,20 @@ class Server : public std::enable_shared_from_this<Server>
 protected:
     Server(int port, uint32_t maxClientsAllowed = -1);
 
+    /**
+    * Creates the server from a ServerConfig.
+    * 
+    * @param [in] config
+    *       Settings of the server, e.g. port and number of io_context threads.
+    */
+    Server(const ServerConfig& config);
+
 public:
     virtual ~Server();
 
     /**
-    * Starts the async operation to accept client connections and then starts the Context Thread.
-    * This order is important as without any task, the context thread would return.
+    * Starts the async operation to accept client connections and then starts the Context Threads.
+    * This order is important as without any task, the context threads would return.
     */
     bool Start();
 
@@ -51,12 +107,127 @@ public:
 
     /**
     * This function is a callback which is called when data is received for any client.
+    * It is not called when the server uses framing, see OnMessage().
     * 
     * @params [in] clientID
     *       ID of the client that has just connected to this server.
     * 
     */
-    virtual void OnDataReceived(ClientID ID) = 0;
+    virtual void OnDataReceived(ClientID ID) { (void)ID; }
+
+    /**
+    * This function is a callback which is called directly from the read completion handler of a client,
+    * with the bytes that were just read. It is not called when the server uses framing, see OnMessage().
+    * Overriding this instead of OnDataReceived(ClientID) avoids the client lookup and the copy of the data.
+    * The default implementation calls OnDataReceived(ClientID).
+    * 
+    * @params [in] client
+    *       Handler of the client that sent the data. Only valid during the call, keep its ID to refer to it later.
+    * 
+    * @params [in] data
+    *       Bytes that were read from the client. Only valid during the call.
+    */
+    virtual void OnDataReceived(ClientHandler& client, std::span<const uint8_t> data);
+
+    /**
+    * This function is a callback which is called with every complete message received from any client,
+    * when the server is configured with a ServerConfig::Framing mode other than FramingMode::None.
+    * Many messages may be delivered from a single read.
+    * 
+    * @params [in] ID
+    *       ID of the client that sent the message.
+    * 
+    * @params [in] message
+    *       Bytes of the message, without the framing. Only valid during the call.
+    */
+    virtual void OnMessage(ClientID ID, std::span<const uint8_t> message) { (void)ID; (void)message; }
+
+    /**
+    * This function is a callback which is called when a client starts sending a message that is larger than
+    * FramingOptions::StreamingThreshold. The message is then delivered in chunks through OnMessageChunk() as they
+    * arrive, followed by OnMessageEnd(), instead of through OnMessage(). A client streams one message at a time.
+    * 
+    * @params [in] ID
+    *       ID of the client that sends the message.
+    * 
+    * @params [in] size
+    *       Size of the whole message, without the framing.
+    */
+    virtual void OnMessageBegin(ClientID ID, uint64_t size) { (void)ID; (void)size; }
+
+    /**
+    * This function is a callback which is called with the next bytes of the message that a client is streaming.
+    * 
+    * @params [in] ID
+    *       ID of the client that sends the message.
+    * 
+    * @params [in] chunk
+    *       Next bytes of the message. Only valid during the call.
+    */
+    virtual void OnMessageChunk(ClientID ID, std::span<const uint8_t> chunk) { (void)ID; (void)chunk; }
+
+    /**
+    * This function is a callback which is called after the last chunk of the message that a client is streaming.
+    * 
+    * @params [in] ID
+    *       ID of the client that sent the message.
+    */
+    virtual void OnMessageEnd(ClientID ID) { (void)ID; }
+
+    /**
+    * This function is a callback which is called when the protocol of a client is detected,
+    * when the server is configured with ServerConfig::Protocols. It is called before any data of the client is delivered.
+    * 
+    * @params [in] ID
+    *       ID of the client.
+    * 
+    * @params [in] protocolIndex
+    *       Index of the protocol in ServerConfig::Protocols, also available through ClientHandler::GetProtocolIndex().
+    * 
+    * @return
+    *       return value indicates whether the server should keep the connection or not.
+    */
+    virtual bool OnProtocolDetected(ClientID ID, std::size_t protocolIndex) { (void)ID; (void)protocolIndex; return true; }
+
+    /**
+    * This function is a callback which is called when a message would take the outbound queue of a client above
+    * ServerConfig::MaxOutboundBytes, before ServerConfig::OutboundLimitPolicy is applied to the message.
+    * It is called on the client's strand, from within the write call when that is made on the strand,
+    * so it must not write to the same client.
+    * 
+    * @params [in] ID
+    *       ID of the client that does not read its data fast enough.
+    * 
+    * @params [in] queuedBytes
+    *       Number of bytes queued for the client, without the new message.
+    */
+    virtual void OnClientBackpressure(ClientID ID, std::size_t queuedBytes) { (void)ID; (void)queuedBytes; }
+
+    /**
+    * This function is a callback which is called when the outbound queue of a client goes above
+    * ServerConfig::OutboundHighWatermark, so that the producers of its data can slow down.
+    * It is called on the client's strand, see OnClientBackpressure().
+    * 
+    * @params [in] ID
+    *       ID of the client.
+    * 
+    * @params [in] queuedBytes
+    *       Number of bytes queued for the client.
+    */
+    virtual void OnOutboundHighWatermark(ClientID ID, std::size_t queuedBytes) { (void)ID; (void)queuedBytes; }
+
+    /**
+    * This function is a callback which is called when the outbound queue of a client drops back to
+    * ServerConfig::OutboundLowWatermark, after it went above the high watermark.
+    * It is called on the client's strand, see OnClientBackpressure().
+    * 
+    * @params [in] ID
+    *       ID of the client.
+    * 
+    * @params [in] queuedBytes
+    *       Number of bytes queued for the client.
+    */
+    virtual void OnOutboundLowWatermark(ClientID ID, std::size_t queuedBytes) { (void)ID; (void)queuedBytes; }
 
     /**
     * This function is called when any errorneous data is received from any client.
@@ -128,6 +299,20 @@ public:
     */
     void MessageClient(ClientID ID, const std::vector<uint8_t>& buffer, std::size_t numBytesToWrite);
 
+    /**
+    * This function can be used to send a shared payload to a specific Client, without copying the payload.
+    *
+    * @param [in] ID
+    *       ID of the client to send the data to.
+    *
+    * @param [in] payload
+    *       Byte data that is to be sent to the Client.
+    *
+    * @param [in] priority
+    *       Lane of the client's outbound queue, control messages go ahead of the queued bulk messages, see MessagePriority.
+    */
+    void MessageClient(ClientID ID, const SharedPayload& payload, MessagePriority priority = MessagePriority::Bulk);
+
     /**
     * This function can be used to send a buffer in the form of IOBuffer to all the clients that are connected to this server.
     *
@@ -181,6 +366,58 @@ public:
     */
     void MessageAllClients(const std::vector<uint8_t>& buffer, std::size_t numBytesToWrite, ClientID ID = 0);
 
+    /**
+    * This function can be used to send a shared payload to all the clients that are connected to this server.
+    * Every client only references the payload, so the bytes are never copied, however many clients there are.
+    * The payload is queued to every client before this call returns, so the messages that the same thread sends to a
+    * client afterwards, e.g. with MessageClient(), are written after it. This holds for all the overloads.
+    *
+    * @params [in] payload
+    *       Bytes of data that needs to be sent.
+    *
+    * @param [in] clientToIgnore
+    *       Optional param, ID of the client that we want to ignore sending the payload to.
+    *
+    * @param [in] priority
+    *       Lane of the clients' outbound queues, see MessagePriority.
+    *
+    */
+    void MessageAllClients(const SharedPayload& payload, ClientID ID = 0, MessagePriority priority = MessagePriority::Bulk);
+
+    /**
+    * This function can be used to send a conflated update to a specific Client, e.g. the latest price of an instrument.
+    * If an update with the same key is still queued to the client and not being written yet, it is replaced by this one
+    * in its place, so a client that falls behind only gets the latest update of every key, in the order of the keys.
+    *
+    * @param [in] ID
+    *       ID of the client to send the data to.
+    *
+    * @param [in] key
+    *       Conflation key of the update.
+    *
+    * @param [in] payload
+    *       Byte data that is to be sent to the Client.
+    */
+    void MessageClientConflated(ClientID ID, ConflationKey key, const SharedPayload& payload);
+
+    /**
+    * This function can be used to send a conflated update to all the clients that are connected to this server,
+    * see MessageClientConflated(). Every client conflates its own queue, so the clients that keep up get every update,
+    * and the memory and the catch up time of the ones that fall behind are bounded by the number of keys.
+    * Like MessageAllClients(), the update is ordered before the messages that the same thread sends afterwards.
+    *
+    * @params [in] key
+    *       Conflation key of the update.
+    *
+    * @params [in] payload
+    *       Bytes of data that needs to be sent.
+    *
+    * @param [in] clientToIgnore
+    *       Optional param, ID of the client that we want to ignore sending the payload to.
+    *
+    */
+    void MessageAllClientsConflated(ConflationKey key, const SharedPayload& payload, ClientID ID = 0);
+
     /**
     * Synchronous function to directly write string data to a socket.
     *
@@ -216,6 +453,7 @@ public:
 
     /**
     * Synchronous function to write data through a client handler pointer.
+    * Blocks till all the bytes are written, whatever read mode the client uses, see ClientHandler::Write().
     *
     * @params [in] client
     *       Pointer to the client handler to write data to.
@@ -255,20 +493,117 @@ public:
     void AsyncWrite(ClientID ID, const std::vector<uint8_t>& buffer, std::size_t numBytesToWrite = 0);
 
     /**
-    * This function makes the main thread wait, till boost::asio::io_context runs out of jobs to perform.
+    * Asynchronous function to send a file, or a range of it, to a Client.
+    * The file is sent in order with the messages written to the client, from the file to the socket inside the kernel
+    * where the platform allows it (sendfile() on Linux, TransmitFile() on Windows), so it is never copied into the process.
+    * The range is written as a whole, even the MessagePriority::Control messages that are queued meanwhile wait for its
+    * end, so that no message lands in the middle of the file. Send a large file as several ranges to let them through.
+    *
+    * @params [in] ID
+    *       ID of the client to send the file to.
+    *
+    * @params [in] path
+    *       Path of the file to send.
+    *
+    * @params [in] offset
+    *       Offset in the file of the first byte to send.
+    *
+    * @params [in] length
+    *       Number of bytes to send. If 0, everything from 'offset' to the end of the file is sent.
+    *
+    * @params [in] onSent
+    *       Called on the client's strand once the file is sent, or failed to be sent, e.g. because the client disconnected.
+    *
+    * @return
+    *       False, if the client is not connected or the file could not be opened. 'onSent' is not called in that case.
+    */
+    bool SendFile(ClientID ID, const std::string& path, uint64_t offset = 0, uint64_t length = 0, OnFileSentCallback onSent = nullptr);
+
+    /**
+    * Asynchronous function to send a range of a file that is already open to a Client, see SendFile(ClientID, const std::string&, ...).
+    * The handle is not closed by the server, it must stay open till 'onSent' is called.
+    */
+    bool SendFile(ClientID ID, FileTransfer::NativeHandle file, uint64_t offset = 0, uint64_t length = 0, OnFileSentCallback onSent = nullptr);
+
+    /**
+    * Stops reading from a client, so that TCP backpressure reaches it. A read that is already in flight is still delivered.
+    *
+    * @params [in] ID
+    *       ID of the client to stop reading from.
+    */
+    void PauseReading(ClientID ID);
+
+    /**
+    * Resumes reading from a client after PauseReading().
+    *
+    * @params [in] ID
+    *       ID of the client to read from again.
+    */
+    void ResumeReading(ClientID ID);
+
+    /**
+    * Reports data of a client that the application has queued for processing.
+    * Reading from the client is paused once it has more than ServerConfig::InboundHighWatermark queued.
+    *
+    * @params [in] ID
+    *       ID of the client that the data was received from.
+    *
+    * @params [in] bytes
+    *       Size of the data that was queued.
+    */
+    void ReportInboundQueued(ClientID ID, std::size_t bytes);
+
+    /**
+    * Reports queued data of a client that the application has processed.
+    * Reading from the client is resumed once it has ServerConfig::InboundLowWatermark or less queued.
+    *
+    * @params [in] ID
+    *       ID of the client that the data was received from.
+    *
+    * @params [in] bytes
+    *       Size of the data that was processed.
+    */
+    void ReportInboundConsumed(ClientID ID, std::size_t bytes);
+
+    /**
+    * Returns the time at which the kernel received the latest data of a client, see ServerConfig::UseReceiveTimestamps.
+    * Called from OnDataReceived() or OnMessage(), this is the receive time of the data being delivered.
+    *
+    * @params [in] ID
+    *       ID of the client that the data was received from.
+    */
+    ReceiveClock::time_point GetLastReceiveTimestamp(ClientID ID);
+
+    /**
+    * This function makes the main thread wait, till all the Context Threads run out of jobs to perform.
     */
     void Wait();
 
     /**
     * Return the number of clients currently connected to the server.
     */
-    std::size_t GetNumClients() const { return m_ClientHandlers.size(); }
+    std::size_t GetNumClients() const { return m_NumClients; }
 
     /**
     * Returns the port number of the server.
     */
     int GetPort() const { return m_Port; }
 
+    /**
+    * Returns the number of threads that run the io_context of each shard.
+    */
+    uint32_t GetNumThreads() const { return m_NumThreads; }
+
+    /**
+    * Returns the statistics of the server.
+    */
+    const ServerStats& GetStats() const { return m_Stats; }
+
+    /**
+    * Returns the number of shards of the server.
+    */
+    uint32_t GetNumShards() const { return static_cast<uint32_t>(m_Shards.size()); }
+
 protected:
 
     /**
@@ -284,46 +619,87 @@ protected:
     * 
     * @param [in] ID
     *       ID of the client whose handler is to be retreived.
+    * 
+    * @return
+    *       Pointer to the client handler, nullptr if no client is connected with this ID.
+    *       That includes the IDs of clients that were already removed, whose slot may even hold a newer client by now,
+    *       so callbacks that can run after a client was removed, e.g. OnClientDisconnected(), must check the result.
     */
-    const ClientHandlerSPtr GetClient(ClientID ID) const { return m_ClientHandlers.at(ID); }
+    const ClientHandlerSPtr GetClient(ClientID ID) const;
 
 private:
 
     /**
     * This function is called when the server starts, and adds the job of accepting a new connection to the io_context.
+    * 
+    * @param [in] shard
+    *       Shard whose acceptor will accept the new connection.
+    */
+    void WaitToAcceptNewConnection(ServerShard& shard);
+
+    /**
+    * Creates a client handler for a newly accepted socket and adds it to the given shard.
+    * 
+    * @param [in] shard
+    *       Shard on whose io_context the socket was accepted, the client will live on this shard.
+    * 
+    * @param [in] socket
+    *       boost::asio::ip::tcp::socket object, that is a handle to the newly connected client.
+    * 
+    * @return
+    *       return value indicates whether the server accepted the connection or not.
+    */
+    bool AddClient(ServerShard& shard, boost::asio::ip::tcp::socket socket);
+
+    /**
+    * Queues a payload to all the clients of every shard, see MessageAllClients() and MessageAllClientsConflated().
+    * 
+    * @param [in] key
+    *       If set, the payload is conflated by this key.
     */
-    void WaitToAcceptNewConnection();
+    void BroadcastWrite(const SharedPayload& payload, ClientID clientToIgnoreID, MessagePriority priority, std::optional<ConflationKey> key);
 
     /**
-    * Helper function to return the io_context.
+    * Returns the shard that will receive the next connection accepted by a shared acceptor.
     */
-    boost::asio::io_context& IOContext() { return m_IOContext; }
+    ServerShard& NextShard();
+
+    /**
+    * Returns the shard that owns the client with the given ID, nullptr if the ID does not belong to any shard.
+    */
+    ServerShard* GetShard(ClientID ID) const;
 
 private:
 
+    /* Settings that the server was created with. */
+    ServerConfig                            m_Config;
+
+    /* Callbacks shared by all the client handlers of this server. */
+    ClientHandlerCallbacks                  m_ClientCallbacks;
+
     /* Port that the server is listening on. */
     int                                     m_Port;
 
-    /* IO context of the server. */
-    boost::asio::io_context                 m_IOContext;
+    /* Number of threads that will run the io_context of each shard. */
+    uint32_t                                m_NumThreads;
 
-    /* Thread on which the io_context performs it's tasks */
-    std::thread                             m_ContextThread;
+    /* Statistics of the server, must outlive the shards as the client handlers update it. */
+    ServerStats                             m_Stats;
 
-    /* Used to accept new client connections to the server. */
-    boost::asio::ip::tcp::acceptor          m_Acceptor;
+    /* Shards of the server, each with its own io_context, threads and clients. */
+    std::vector<std::unique_ptr<ServerShard>>   m_Shards;
 
-    /* Mutext to protect the m_Clients. */
-    std::mutex                              m_MutexClients;
+    /* Index of the shard that will receive the next connection accepted by a shared acceptor. */
+    std::atomic<uint32_t>                   m_NextShardIndex;
 
-    /* Map of ClientID against the Client Handler pointer. */
-    std::unordered_map<ClientID, std::shared_ptr<ClientHandler>>   m_ClientHandlers;
+    /* Number of clients connected to all the shards. */
+    std::atomic<std::size_t>                m_NumClients;
 
-    /* ID that will be assigned to the next client that will connect to the server. */
-    uint32_t                                m_NewClientID;
+    /* True, if every shard has its own SO_REUSEPORT acceptor and keeps the clients that it accepts. */
+    bool                                    m_ShardsAcceptOwnClients;
 
     /* Maximum number of clients that are allowed to connect to the server. */
     uint32_t                                m_MaxClientsAllowed;
 };
 
-END_NAMESPACE_TCP
+END_NAMESPACE_TCP
\ No newline at end of file
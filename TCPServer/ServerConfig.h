@@ -0,0 +1,266 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include "TCPCommon/Framing.h"
+#include "TCPCommon/SocketOptions.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <span>
+#include <string_view>
+
+BEGIN_NAMESPACE_TCP
+
+/**
+* Result of a protocol sniffer, see ProtocolOptions::Sniff.
+*/
+enum class SniffResult
+{
+    /* The bytes belong to this protocol. */
+    Match,
+
+    /* The bytes do not belong to this protocol. */
+    NoMatch,
+
+    /* More bytes are needed to decide. */
+    NeedMoreData,
+};
+
+using SniffFunction = std::function<SniffResult(std::span<const uint8_t>)>;
+
+/**
+* What is done with a message that would take the outbound queue of a client above ServerConfig::MaxOutboundBytes.
+* Server::OnClientBackpressure() is called first in every case.
+*/
+enum class SlowConsumerPolicy
+{
+    /* The message is queued anyway, the application decides what to do. */
+    Notify,
+
+    /* The message is dropped. */
+    DropNewest,
+
+    /* The oldest messages that are not being written yet are dropped to make room for the message. */
+    DropOldest,
+
+    /* The client is disconnected. */
+    Disconnect,
+};
+
+/**
+* Lane of the outbound queue of a client that a message is queued to.
+* Control messages go ahead of the bulk messages that are not being written yet, but never into the middle of one,
+* so the byte stream of every message stays intact. See ServerConfig::BulkBatchMaxBytes.
+*/
+enum class MessagePriority
+{
+    /*
+    * Small, latency sensitive messages, e.g. heartbeats, acks and cancellations. Written right away, even when coalescing.
+    * A file that is being sent is a single message too, so a control message waits till the whole range of the file is
+    * sent. Sending a large file as several ranges, see Server::SendFile(), lets control messages go out in between.
+    */
+    Control,
+
+    /* Everything else, written in the order it was queued, together with the files. */
+    Bulk,
+};
+
+/**
+* Key of a conflated message, e.g. the ID of an instrument, see Server::MessageClientConflated().
+* A queued message that is not being written yet is replaced by a newer message with the same key.
+*/
+using ConflationKey = uint64_t;
+
+/**
+* A protocol that the server can detect on a connection, see ServerConfig::Protocols.
+*/
+struct ProtocolOptions
+{
+    /* Name of the protocol, e.g. for logging. */
+    std::string     Name;
+
+    /* Decides from the first bytes of a connection whether it speaks this protocol. The bytes are only valid during the call. */
+    SniffFunction   Sniff;
+
+    /* Framing of the connections that speak this protocol. */
+    FramingOptions  Framing;
+};
+
+/**
+* Sniffs a protocol whose connections start with a fixed prefix, e.g. "GET " for HTTP.
+*
+* @param [in] data
+*       First bytes of the connection.
+*
+* @param [in] prefix
+*       Bytes that the connections of the protocol start with.
+*/
+inline SniffResult SniffPrefix(std::span<const uint8_t> data, std::string_view prefix)
+{
+    std::size_t size = std::min(data.size(), prefix.size());
+    if (std::memcmp(data.data(), prefix.data(), size) != 0)
+        return SniffResult::NoMatch;
+
+    return size == prefix.size() ? SniffResult::Match : SniffResult::NeedMoreData;
+}
+
+/**
+* Holds the settings that are used to construct a net::tcp::Server.
+* The default values give the same behaviour as Server(port, maxClientsAllowed).
+*/
+struct ServerConfig
+{
+    /* Port that the server will listen on. */
+    int             Port = 0;
+
+    /* Maximum number of clients that are allowed to connect to the server. */
+    uint32_t        MaxClientsAllowed = static_cast<uint32_t>(-1);
+
+    /*
+    * Number of threads that run the io_context of each shard.
+    * Every client's read/write handlers run on a strand, so the handlers of a single client
+    * never run concurrently, even when this is greater than 1.
+    */
+    uint32_t        NumThreads = 1;
+
+    /*
+    * Number of shards of the server, each with its own io_context, threads and client map.
+    * For shared-nothing shard-per-core mode, set this to the number of cores and NumThreads to 1.
+    * Where SO_REUSEPORT is available every shard gets its own acceptor, else the first shard accepts
+    * all the connections and hands them out to the shards round-robin.
+    * At most 256 shards are supported.
+    */
+    uint32_t        NumShards = 1;
+
+    /*
+    * Framing of the byte stream of every client.
+    * With FramingMode::None the raw chunks are delivered to Server::OnDataReceived(),
+    * else every complete message is delivered to Server::OnMessage().
+    */
+    FramingOptions  Framing;
+
+    /*
+    * Bounds of the per-client read buffer.
+    * Every client starts with ReadBufferInitialSize. The buffer is doubled when reads repeatedly fill it,
+    * and halved after a long run of reads that use less than a quarter of it, always staying within [Min, Max].
+    * Set all three to the same value for a fixed size buffer.
+    */
+    std::size_t     ReadBufferMinSize = 256;
+    std::size_t     ReadBufferInitialSize = 1 * 1024;
+    std::size_t     ReadBufferMaxSize = 64 * 1024;
+
+    /*
+    * Idle mode for servers with many mostly idle connections.
+    * Instead of keeping a read pending on its own buffer, every client waits for its socket to become readable,
+    * then borrows a ReadBufferMaxSize buffer from a per-thread pool, reads, delivers the data and returns the buffer.
+    * Idle clients then hold no read buffer at all, at the cost of one extra non-blocking read call per wake up.
+    */
+    bool            UseSharedReadBuffers = false;
+
+    /*
+    * Drain mode of the reads, disabled when ReadDrainMaxBytes is 0.
+    * After a read completes, the client keeps reading with non-blocking reads till the socket has no more data,
+    * or till it has read ReadDrainMaxBytes bytes or ReadDrainMaxReads chunks in a row. It then yields to the other
+    * clients of its shard before reading again, so a bulk sender saves reactor round trips without starving the rest.
+    */
+    std::size_t     ReadDrainMaxBytes = 0;
+    uint32_t        ReadDrainMaxReads = 16;
+
+    /*
+    * Only used with framing, and not with UseSharedReadBuffers.
+    * The reads go into a ReadBufferMaxSize ring buffer whose memory is mapped twice, see net::MirroredRingBuffer,
+    * so a message that is split across reads is parsed in place once it is complete, instead of being copied.
+    * Messages larger than the ring buffer are still reassembled by copying.
+    * Every client then holds a fixed ReadBufferMaxSize ring instead of the adaptive buffer, rounded up to the allocation
+    * granularity (the page size, 64 KB on Windows): twice that in address space, and up to once that in memory as it
+    * is touched. It also takes two mappings, which count against vm.max_map_count on Linux (65530 by default, so about
+    * 32K clients), and briefly a memfd (Linux) or keeps a section handle (Windows). A client whose ring cannot be mapped
+    * uses the copying read buffer instead, see ServerStats::GetMirroredReadBufferFallbacks().
+    */
+    bool            UseMirroredReadBuffer = false;
+
+    /*
+    * Protocols that are served on the port, in order of priority. Empty to serve only the protocol of 'Framing'.
+    * The first bytes of every new connection are given to the Sniff function of each protocol in turn, the first one
+    * that matches decides the framing of the connection, see Server::OnProtocolDetected(). A protocol that needs more
+    * data holds back the ones after it. The bytes are sniffed in place in the read buffer and then delivered as usual,
+    * so they are not copied. A connection that matches no protocol within its first read buffer is disconnected.
+    * The mirrored read buffer is not used on sniffed connections.
+    */
+    std::vector<ProtocolOptions>    Protocols;
+
+    /*
+    * Watermarks of the inbound flow control, disabled when InboundHighWatermark is 0.
+    * The application reports the data that it has queued for processing with Server::ReportInboundQueued() and
+    * Server::ReportInboundConsumed(). Reading from a client is paused once its queued data goes above the high watermark,
+    * and resumed once it drops to the low watermark, so that TCP backpressure reaches the sender.
+    */
+    std::size_t     InboundHighWatermark = 0;
+    std::size_t     InboundLowWatermark = 0;
+
+    /*
+    * Reads with recvmsg() and takes the time at which the kernel received the data from the SO_TIMESTAMPNS control
+    * message, see Server::GetLastReceiveTimestamp(). The delay between the kernel and the delivery of the data, and the
+    * time spent delivering it, are recorded in ServerStats, so network and kernel queueing can be told apart from the
+    * server's own handling. Like UseSharedReadBuffers, every read waits for the socket to become readable first.
+    * Where the kernel timestamps are not available (anything but Linux), the time of the read is used instead, the
+    * queueing delays are not recorded then and the clients are counted in ServerStats::GetReceiveTimestampFallbacks().
+    */
+    bool            UseReceiveTimestamps = false;
+
+    /*
+    * Write coalescing (corking). The messages that are queued to a client are not written right away, but at the end
+    * of the current turn of its strand, so all the messages that are queued while handling e.g. one inbound message
+    * go out with a single gather write. With a WriteCoalescingDelay above 0 the write is held back for up to that long
+    * to collect more messages, unless WriteCoalescingMaxBytes are queued before. Messages that are queued while a write
+    * is in flight are always written together right after it, with or without coalescing.
+    */
+    bool                        CoalesceWrites = false;
+    std::chrono::microseconds   WriteCoalescingDelay{ 0 };
+    std::size_t                 WriteCoalescingMaxBytes = 64 * 1024;
+
+    /*
+    * Limit of the data that is queued to be written to a client, including the batch that is being written,
+    * so that a client that stops reading cannot make the server grow without bound. Unlimited when 0.
+    * A message that would go above it is handled according to OutboundLimitPolicy, see Server::OnClientBackpressure().
+    */
+    std::size_t                 MaxOutboundBytes = 0;
+    SlowConsumerPolicy          OutboundLimitPolicy = SlowConsumerPolicy::DropNewest;
+
+    /*
+    * Watermarks of the outbound queue of every client, disabled when OutboundHighWatermark is 0.
+    * Server::OnOutboundHighWatermark() is called once the queued data goes above the high watermark,
+    * and Server::OnOutboundLowWatermark() once it drops back to the low watermark, so producers can throttle.
+    */
+    std::size_t                 OutboundHighWatermark = 0;
+    std::size_t                 OutboundLowWatermark = 0;
+
+    /*
+    * Batches of outbound messages of at least this many bytes are written with MSG_ZEROCOPY, so the kernel sends
+    * straight from the payloads instead of copying them, disabled when 0. The payloads are held till the kernel reports
+    * that it is done with them, which pairs well with shared broadcast payloads. Only available on Linux.
+    * Pinning the pages costs more than copying small buffers, so this pays off from tens of KB on, the zerocopy
+    * benchmark measures the crossover. Over the loopback interface the kernel copies anyway and it never pays off.
+    * The clients on whose socket it cannot be enabled copy all their writes, see ServerStats::GetZeroCopyFallbacks().
+    */
+    std::size_t                 ZeroCopyThreshold = 0;
+
+    /*
+    * Limit of the bulk messages that go into a single write, unlimited when 0. The control messages that are queued
+    * while a batch is in flight are written before the rest of the bulk messages, so this bounds how long they wait
+    * behind bulk data. The bulk messages are never split, a message larger than the limit is written on its own.
+    */
+    std::size_t                 BulkBatchMaxBytes = 0;
+
+    /*
+    * Options that are applied to every accepted client socket, before the client is handed to the server.
+    * The buffer sizes are also set on the listening socket, so that the window scale of the connection is negotiated
+    * with them during the handshake, which setting them on the accepted socket is too late for.
+    */
+    SocketOptions               ClientSocketOptions;
+
+    /* Length of the queue of the connections that are not accepted yet, 0 for the maximum of the OS (SOMAXCONN). */
+    int                         ListenBacklog = 0;
+};
+
+END_NAMESPACE_TCP
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include "TCPCommon/SocketOptions.h"
+#include "ClientRegistry.h"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+
+BEGIN_NAMESPACE_TCP
+
+/**
+* Immutable snapshot of the clients of a ServerShard, that broadcasts iterate without taking any lock.
+*
+* The snapshot lists the clients by plain pointers, so publishing it touches no reference count of any client.
+* A snapshot that is replaced, and a client that is removed, are parked by the shard till no reader can still use
+* them, see ServerShard::ReclaimRetired(). The snapshot also maps the slots of the ClientRegistry to the clients,
+* so that looking a client up by its ID does not take the lock of the shard either.
+*/
+struct ClientSnapshot
+{
+    /* IDs of the clients, IDs[i] is the ID of Clients[i]. */
+    std::vector<ClientID>               IDs;
+
+    /* The clients. */
+    std::vector<ClientHandler*>         Clients;
+
+    /* Index into IDs and Clients by the slot index of a ClientID, NoClient for a free slot. */
+    std::vector<uint32_t>               ClientIndices;
+
+    static constexpr uint32_t NoClient = static_cast<uint32_t>(-1);
+};
+
+/**
+* A shard of the Server.
+*
+* Each shard owns an io_context, the threads that run it, optionally its own acceptor, and the clients
+* that were accepted on it. A client lives entirely on the shard that accepted it, so in shard-per-core mode
+* the accept path and the client map of a shard are never touched by the threads of another shard.
+*/
+class ServerShard
+{
+public:
+
+    /**
+    * @param [in] index
+    *       Index of this shard in the server.
+    *
+    * @param [in] numThreads
+    *       Number of threads that will run the io_context of this shard.
+    */
+    ServerShard(uint32_t index, uint32_t numThreads);
+
+    ServerShard(const ServerShard&) = delete;
+    ServerShard(ServerShard&&) = delete;
+
+    ~ServerShard();
+
+    /**
+    * Creates an acceptor for this shard, listening on the given port.
+    *
+    * @param [in] port
+    *       Port to listen on.
+    *
+    * @param [in] reusePort
+    *       If true, SO_REUSEPORT is set on the acceptor, so that multiple shards can listen on the same port
+    *       and the kernel balances the incoming connections between them.
+    *
+    * @param [in] backlog
+    *       Length of the queue of the connections that are not accepted yet, 0 for the maximum of the OS.
+    *
+    * @param [in] socketOptions
+    *       Options of the client sockets, the buffer sizes are set on the acceptor so that the accepted sockets inherit them.
+    */
+    void OpenAcceptor(int port, bool reusePort, int backlog, const SocketOptions& socketOptions);
+
+    /**
+    * Starts the threads that run the io_context of this shard.
+    */
+    void Start();
+
+    /**
+    * Stops the io_context of this shard.
+    */
+    void Stop();
+
+    /**
+    * Waits for all the threads of this shard to finish.
+    */
+    void Join();
+
+    /**
+    * Adds a new client to this shard.
+    *
+    * @return
+    *       ID of the newly added client.
+    */
+    ClientID AddClient(const std::function<ClientHandlerSPtr(ClientID)>& createClient);
+
+    /**
+    * Removes a client from this shard.
+    *
+    * @return
+    *       True, if the client was present in this shard.
+    */
+    bool RemoveClient(ClientID ID);
+
+    /**
+    * Returns the client with the given ID, nullptr if it is not connected to this shard.
+    * The client is looked up in the latest snapshot without taking a lock, so any thread can call it on the hot path.
+    */
+    ClientHandlerSPtr GetClient(ClientID ID) const;
+
+    /**
+    * Calls 'func' for every client in the latest snapshot of this shard.
+    * No lock is taken, clients that connect or disconnect while iterating may or may not be visited.
+    * A client that is removed meanwhile stays alive till the walk is over and the handlers that 'func' dispatched or
+    * posted to the strand of the client have run, so they do not need to hold a reference of the client.
+    */
+    void ForEachClient(const std::function<void(ClientID, ClientHandler&)>& func);
+
+    /**
+    * Returns the number of clients connected to this shard.
+    */
+    std::size_t GetNumClients() const;
+
+    /**
+    * Returns the index of this shard in the server.
+    */
+    uint32_t GetIndex() const { return m_Index; }
+
+    /**
+    * Returns the io_context of this shard.
+    */
+    boost::asio::io_context& IOContext() { return m_IOContext; }
+
+    /**
+    * Returns the acceptor of this shard, nullptr if this shard does not accept connections itself.
+    */
+    boost::asio::ip::tcp::acceptor* GetAcceptor() { return m_Acceptor.get(); }
+
+    /**
+    * Returns the index of the shard that owns the client with the given ID.
+    */
+    static uint32_t GetShardIndex(ClientID ID) { return ClientRegistry::GetShardIndex(ID); }
+
+private:
+
+    /**
+    * Keeps the epoch of the shard from moving on by two, while a reader uses the snapshot it loaded after pinning it.
+    */
+    class EpochPin
+    {
+    public:
+        explicit EpochPin(const ServerShard& shard);
+        ~EpochPin();
+
+        EpochPin(const EpochPin&) = delete;
+        EpochPin& operator=(const EpochPin&) = delete;
+
+    private:
+        const ServerShard&  m_Shard;
+        uint64_t            m_Epoch;
+    };
+
+    /**
+    * A snapshot or a client that was unlinked in the epoch 'Epoch', that readers may still use.
+    */
+    struct RetiredEntry
+    {
+        uint64_t                                Epoch;
+        std::unique_ptr<const ClientSnapshot>   Snapshot;
+        ClientHandlerSPtr                       Client;
+    };
+
+    /**
+    * Publishes a new snapshot of the registry, must be called under m_MutexClients.
+    *
+    * @param [in] removedClient
+    *       Client that was just removed from the registry, it is retired together with the replaced snapshot.
+    */
+    void PublishSnapshot(ClientHandlerSPtr removedClient = nullptr);
+
+    /**
+    * Moves the epoch on as far as the readers allow, and releases what was retired two epochs ago or earlier.
+    * A reader pins the epoch that is current when it starts, and the epoch only moves on from E to E + 1 once no reader
+    * is left in E - 1, so once the epoch is E + 2 every reader that could have seen an entry retired in E is gone.
+    * A client is released on its strand, after the handlers that the readers queued to it. Must be called under m_MutexClients.
+    */
+    void ReclaimRetired();
+
+    /**
+    * Releases the retired entries after a walk, if there are any and the clients mutex is free.
+    */
+    void TryReclaimRetired();
+
+private:
+
+    /* Index of this shard in the server. */
+    const uint32_t                                  m_Index;
+
+    /* Number of threads that run the io_context. */
+    const uint32_t                                  m_NumThreads;
+
+    /* IO context of this shard. */
+    boost::asio::io_context                         m_IOContext;
+
+    /* Threads on which the io_context performs it's tasks */
+    std::vector<std::thread>                        m_ContextThreads;
+
+    /* Used to accept new client connections on this shard. */
+    std::unique_ptr<boost::asio::ip::tcp::acceptor> m_Acceptor;
+
+    /* Mutex to protect the m_ClientHandlers. */
+    mutable std::mutex                              m_MutexClients;
+
+    /* Slot map of the clients of this shard. */
+    ClientRegistry                                  m_ClientHandlers;
+
+    /* Latest snapshot of m_ClientHandlers, republished on every connect/disconnect. Owned by m_CurrentSnapshot. */
+    std::atomic<const ClientSnapshot*>              m_Snapshot;
+    std::unique_ptr<const ClientSnapshot>           m_CurrentSnapshot;
+
+    /* Epoch of the snapshots, and the number of readers that pinned an even and an odd epoch. */
+    std::atomic<uint64_t>                           m_Epoch;
+    mutable std::atomic<std::size_t>                m_NumReaders[2];
+
+    /* Snapshots and clients that readers may still use, in the order they were retired. */
+    std::deque<RetiredEntry>                        m_Retired;
+
+    /* Size of m_Retired, so the readers only go for the mutex when there is something to release. */
+    std::atomic<std::size_t>                        m_NumRetired;
+};
+
+END_NAMESPACE_TCP
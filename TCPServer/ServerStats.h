@@ -0,0 +1,298 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+
+BEGIN_NAMESPACE_TCP
+
+/**
+* Statistics of a Server, updated by its ClientHandlers.
+* All the counters are atomic, so they can be read from any thread while the server is running.
+* The counters that are updated on every read or write are kept per shard, each on its own cache line, and summed
+* when they are read, so the shards do not contend for them.
+*/
+class ServerStats
+{
+public:
+
+    /* Number of buckets of the read buffer size histogram, bucket 'i' counts the buffers of size [2^i, 2^(i+1)). */
+    static constexpr std::size_t NumSizeBuckets = 32;
+
+    using SizeHistogram = std::array<uint64_t, NumSizeBuckets>;
+
+    /* Number of buckets of the latency histograms, bucket 'i' counts the latencies of [2^i, 2^(i+1)) microseconds. */
+    static constexpr std::size_t NumLatencyBuckets = 32;
+
+    using LatencyHistogram = std::array<uint64_t, NumLatencyBuckets>;
+
+    /**
+    * @param [in] numShards
+    *       Number of shards of the server, the counters of a shard are only updated by its clients.
+    */
+    explicit ServerStats(uint32_t numShards = 1);
+
+    /**
+    * Called when a client allocates its read buffer.
+    */
+    void OnReadBufferAllocated(std::size_t size);
+
+    /**
+    * Called when a client releases its read buffer.
+    */
+    void OnReadBufferReleased(std::size_t size);
+
+    /**
+    * Called when a client resizes its read buffer.
+    */
+    void OnReadBufferResized(std::size_t oldSize, std::size_t newSize);
+
+    /**
+    * Called when a client delivered data that was read with a receive timestamp, see ServerConfig::UseReceiveTimestamps.
+    *
+    * @param [in] shardIndex
+    *       Shard of the client.
+    *
+    * @param [in] queueingDelay
+    *       Time from the kernel receiving the data till the delivery started, not set if the kernel did not stamp the data.
+    *
+    * @param [in] handlingDelay
+    *       Time that the delivery took, i.e. spent in the OnDataReceived()/OnMessage() callbacks.
+    */
+    void OnReceiveTimed(uint32_t shardIndex, std::optional<std::chrono::nanoseconds> queueingDelay, std::chrono::nanoseconds handlingDelay);
+
+    /**
+    * Called when the receive timestamps of a client could not be enabled, see ServerConfig::UseReceiveTimestamps.
+    */
+    void OnReceiveTimestampFallback() { m_ReceiveTimestampFallbacks.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+    * Called when a message is added to the outbound queue of a client of the given shard.
+    * Only called when ServerConfig::MaxOutboundBytes or ServerConfig::OutboundHighWatermark is set.
+    */
+    void OnOutboundQueued(uint32_t shardIndex, std::size_t size)
+    {
+        m_Shards[shardIndex].OutboundQueuedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    /**
+    * Called when messages leave the outbound queue of a client of the given shard, written, dropped or discarded with the client.
+    */
+    void OnOutboundReleased(uint32_t shardIndex, std::size_t size)
+    {
+        m_Shards[shardIndex].OutboundQueuedBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    /**
+    * Called when messages are dropped because of ServerConfig::MaxOutboundBytes.
+    */
+    void OnOutboundDropped(std::size_t numMessages, std::size_t size);
+
+    /**
+    * Called when a queued message is replaced by a newer message with the same conflation key.
+    *
+    * @param [in] size
+    *       Size of the message that was replaced.
+    */
+    void OnOutboundConflated(std::size_t size);
+
+    /**
+    * Called when a client is disconnected because of ServerConfig::MaxOutboundBytes.
+    */
+    void OnSlowConsumerDisconnected() { m_SlowConsumerDisconnects.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+    * Called when the mirrored read buffer of a client could not be mapped, see ServerConfig::UseMirroredReadBuffer.
+    */
+    void OnMirroredReadBufferFallback() { m_MirroredReadBufferFallbacks.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+    * Called when MSG_ZEROCOPY could not be enabled on the socket of a client, see ServerConfig::ZeroCopyThreshold.
+    */
+    void OnZeroCopyFallback() { m_ZeroCopyFallbacks.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+    * Called when a client wrote data with MSG_ZEROCOPY, see ServerConfig::ZeroCopyThreshold.
+    */
+    void OnZeroCopySent(std::size_t size) { m_ZeroCopyBytes.fetch_add(size, std::memory_order_relaxed); }
+
+    /**
+    * Called when the kernel completed MSG_ZEROCOPY sends.
+    *
+    * @param [in] numSends
+    *       Number of sendmsg() calls that were completed.
+    *
+    * @param [in] isCopied
+    *       True, if the kernel copied the data after all, e.g. to deliver it over loopback.
+    */
+    void OnZeroCopyCompleted(std::size_t numSends, bool isCopied);
+
+    /**
+    * Returns the number of read buffers per size bucket, see NumSizeBuckets.
+    */
+    SizeHistogram GetReadBufferSizeHistogram() const;
+
+    /**
+    * Returns the total number of bytes of all the read buffers.
+    */
+    uint64_t GetReadBufferBytes() const { return m_ReadBufferBytes.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of times any read buffer was grown.
+    */
+    uint64_t GetReadBufferGrowCount() const { return m_ReadBufferGrowCount.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of times any read buffer was shrunk.
+    */
+    uint64_t GetReadBufferShrinkCount() const { return m_ReadBufferShrinkCount.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the total number of bytes queued to be written to all the clients, including the batches being written.
+    * Only counted when ServerConfig::MaxOutboundBytes or ServerConfig::OutboundHighWatermark is set, 0 otherwise.
+    */
+    uint64_t GetOutboundQueuedBytes() const;
+
+    /**
+    * Returns the number of messages dropped because of ServerConfig::MaxOutboundBytes.
+    */
+    uint64_t GetOutboundDroppedMessages() const { return m_OutboundDroppedMessages.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of bytes dropped because of ServerConfig::MaxOutboundBytes.
+    */
+    uint64_t GetOutboundDroppedBytes() const { return m_OutboundDroppedBytes.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of queued messages that were replaced by newer messages with the same conflation key.
+    */
+    uint64_t GetOutboundConflatedMessages() const { return m_OutboundConflatedMessages.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of bytes of the queued messages that were replaced by newer messages with the same conflation key.
+    */
+    uint64_t GetOutboundConflatedBytes() const { return m_OutboundConflatedBytes.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of clients disconnected because of ServerConfig::MaxOutboundBytes.
+    */
+    uint64_t GetSlowConsumerDisconnects() const { return m_SlowConsumerDisconnects.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of clients that read through the copying buffer, because their mirrored read buffer could not be mapped.
+    */
+    uint64_t GetMirroredReadBufferFallbacks() const { return m_MirroredReadBufferFallbacks.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of clients whose reads are not stamped by the kernel, so their queueing delays are not recorded.
+    */
+    uint64_t GetReceiveTimestampFallbacks() const { return m_ReceiveTimestampFallbacks.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of clients that copy all their writes, because MSG_ZEROCOPY could not be enabled on their socket.
+    */
+    uint64_t GetZeroCopyFallbacks() const { return m_ZeroCopyFallbacks.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of bytes written with MSG_ZEROCOPY.
+    */
+    uint64_t GetZeroCopyBytes() const { return m_ZeroCopyBytes.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of MSG_ZEROCOPY sends that the kernel completed.
+    */
+    uint64_t GetZeroCopyCompletions() const { return m_ZeroCopyCompletions.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of completed MSG_ZEROCOPY sends whose data the kernel copied after all.
+    */
+    uint64_t GetZeroCopyCopiedCompletions() const { return m_ZeroCopyCopiedCompletions.load(std::memory_order_relaxed); }
+
+    /**
+    * Returns the number of deliveries per bucket of the delay from the kernel receiving the data till the delivery started.
+    */
+    LatencyHistogram GetReceiveQueueingHistogram() const { return SumHistogram(&ShardCounters::ReceiveQueueingDelays); }
+
+    /**
+    * Returns the number of deliveries per bucket of the time that the delivery took.
+    */
+    LatencyHistogram GetReceiveHandlingHistogram() const { return SumHistogram(&ShardCounters::ReceiveHandlingDelays); }
+
+    /**
+    * Returns the bucket of the read buffer size histogram that a buffer of the given size is counted in.
+    */
+    static std::size_t GetSizeBucket(std::size_t size);
+
+private:
+
+    /**
+    * Counters of one shard that are updated on every read or write, on cache lines of their own.
+    */
+    struct alignas(64) ShardCounters
+    {
+        /* Number of bytes queued to be written to the clients of the shard. */
+        std::atomic<uint64_t>                                   OutboundQueuedBytes;
+
+        /* Number of deliveries per bucket of the delay from the kernel till the delivery, and of the delivery itself. */
+        std::array<std::atomic<uint64_t>, NumLatencyBuckets>    ReceiveQueueingDelays;
+        std::array<std::atomic<uint64_t>, NumLatencyBuckets>    ReceiveHandlingDelays;
+    };
+
+    using ShardHistogram = std::array<std::atomic<uint64_t>, NumLatencyBuckets> ShardCounters::*;
+
+    /**
+    * Returns the bucket of the latency histograms that a latency is counted in, negative latencies go into the first one.
+    */
+    static std::size_t GetLatencyBucket(std::chrono::nanoseconds latency);
+
+    /**
+    * Returns the sum of a latency histogram over all the shards.
+    */
+    LatencyHistogram SumHistogram(ShardHistogram buckets) const;
+
+private:
+
+    /* Counters of every shard. */
+    std::unique_ptr<ShardCounters[]>                    m_Shards;
+    uint32_t                                            m_NumShards;
+
+    /* Number of read buffers per size bucket. */
+    std::array<std::atomic<uint64_t>, NumSizeBuckets>   m_ReadBufferSizes;
+
+    /* Total number of bytes of all the read buffers. */
+    std::atomic<uint64_t>                               m_ReadBufferBytes;
+
+    /* Number of times any read buffer was grown. */
+    std::atomic<uint64_t>                               m_ReadBufferGrowCount;
+
+    /* Number of times any read buffer was shrunk. */
+    std::atomic<uint64_t>                               m_ReadBufferShrinkCount;
+
+    /* Number of clients whose mirrored read buffer could not be mapped. */
+    std::atomic<uint64_t>                               m_MirroredReadBufferFallbacks;
+
+    /* Number of clients whose receive timestamps could not be enabled. */
+    std::atomic<uint64_t>                               m_ReceiveTimestampFallbacks;
+
+    /* Messages and bytes dropped, and clients disconnected, because of ServerConfig::MaxOutboundBytes. */
+    std::atomic<uint64_t>                               m_OutboundDroppedMessages;
+    std::atomic<uint64_t>                               m_OutboundDroppedBytes;
+    std::atomic<uint64_t>                               m_SlowConsumerDisconnects;
+
+    /* Queued messages and bytes that were replaced by newer messages with the same conflation key. */
+    std::atomic<uint64_t>                               m_OutboundConflatedMessages;
+    std::atomic<uint64_t>                               m_OutboundConflatedBytes;
+
+    /* Number of clients on whose socket MSG_ZEROCOPY could not be enabled. */
+    std::atomic<uint64_t>                               m_ZeroCopyFallbacks;
+
+    /* Bytes written with MSG_ZEROCOPY, and completions of those sends, in total and copied by the kernel after all. */
+    std::atomic<uint64_t>                               m_ZeroCopyBytes;
+    std::atomic<uint64_t>                               m_ZeroCopyCompletions;
+    std::atomic<uint64_t>                               m_ZeroCopyCopiedCompletions;
+};
+
+END_NAMESPACE_TCP
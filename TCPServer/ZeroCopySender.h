@@ -0,0 +1,151 @@
+#pragma once
+
+#include "TCPCommon/Common.h"
+#include "TCPCommon/HandlerAllocator.h"
+#include "TCPCommon/SharedPayload.h"
+#include <boost/asio.hpp>
+#include <deque>
+#include <span>
+
+BEGIN_NAMESPACE_TCP
+
+class ServerStats;
+
+/**
+* Writes large batches of a client with MSG_ZEROCOPY, see ServerConfig::ZeroCopyThreshold.
+*
+* The kernel sends straight from the pages of the payloads instead of copying them into the socket buffer, so the
+* payloads must stay untouched till the kernel reports on the socket's error queue that it is done with them.
+* Every sendmsg() call that sends data gets the next number of a per-socket counter, the completions report ranges
+* of these numbers. The payloads of a batch are held till all the calls that sent them are completed.
+*
+* Only available on Linux, this class is not thread safe, it is only used from the strand of its ClientHandler.
+*/
+class ZeroCopySender
+{
+public:
+
+    using WriteHandler = RecyclingFunction<void(const boost::system::error_code&, std::size_t)>;
+
+    ZeroCopySender(boost::asio::ip::tcp::socket& socket, ServerStats& stats);
+
+    /**
+    * Enables MSG_ZEROCOPY on the socket.
+    *
+    * @return
+    *       Empty, if it is enabled. Otherwise why it is not, operation_not_supported on the platforms without
+    *       MSG_ZEROCOPY, for the caller to log.
+    */
+    static boost::system::error_code Enable(boost::asio::ip::tcp::socket& socket);
+
+    /**
+    * Writes all the buffers with MSG_ZEROCOPY, like async_write(). Must be called on the socket's strand.
+    * Once 'handler' is called, the payloads of the buffers must be handed over with HoldUntilCompleted().
+    *
+    * @param [in] buffers
+    *       Buffers to write, must stay valid till 'handler' is called.
+    *
+    * @param [in] handler
+    *       Called on the socket's strand with the result and the number of bytes written, never before AsyncWrite()
+    *       returns, also when the socket takes all the data right away.
+    */
+    void AsyncWrite(std::span<const boost::asio::const_buffer> buffers, WriteHandler handler);
+
+    /**
+    * Keeps the payloads of the last AsyncWrite() alive, till the kernel reports that it does not use them anymore.
+    * The completions are not read here, the owner arms its wait for them first and then calls ReapCompletions().
+    */
+    void HoldUntilCompleted(std::vector<SharedPayload>&& payloads);
+
+    /**
+    * Returns an empty vector, that keeps the capacity of a batch that was released, to collect the next batch in.
+    */
+    std::vector<SharedPayload> TakeSpareBatch();
+
+    /**
+    * Reads all the completions from the error queue of the socket, and releases the batches that are completed.
+    * The owner of the socket calls this after it armed its wait for the error condition of the socket, see
+    * boost::asio::socket_base::wait_error, and again whenever that wait completes. Does nothing while a write is not
+    * held yet, HoldUntilCompleted() is followed by another call.
+    */
+    void ReapCompletions();
+
+    /**
+    * Returns the number of batches that wait for their completions.
+    */
+    std::size_t GetNumHeldBatches() const { return m_HeldBatches.size(); }
+
+private:
+
+    /**
+    * Payloads of a batch that the kernel may still send from.
+    */
+    struct HeldBatch
+    {
+        /* Numbers of the first and the last sendmsg() call that sent the batch. */
+        uint32_t                    FirstID;
+        uint32_t                    LastID;
+
+        /* Number of the calls that are not completed yet. */
+        uint32_t                    NumPending;
+
+        std::vector<SharedPayload>  Payloads;
+    };
+
+    /**
+    * Sends the rest of the buffers, till the socket would block, and continues asynchronously from there.
+    */
+    void SendNext();
+
+    /**
+    * Calls the handler of AsyncWrite().
+    */
+    void Finish(const boost::system::error_code& ec);
+
+    /**
+    * Marks the calls of the given range as completed, on all the held batches.
+    */
+    void OnCompleted(uint32_t firstID, uint32_t lastID, bool isCopied);
+
+    /**
+    * Keeps the emptied vector of a released batch for TakeSpareBatch(), unless enough are kept already.
+    */
+    void RecycleBatch(std::vector<SharedPayload>&& payloads);
+
+private:
+
+    /* Socket of the client, outlives this object. */
+    boost::asio::ip::tcp::socket&           m_Socket;
+
+    /* Statistics of the server. */
+    ServerStats&                            m_Stats;
+
+    /* Buffers of the write in progress and the position of the next byte to send. */
+    std::span<const boost::asio::const_buffer> m_Buffers;
+    std::size_t                             m_BufferIndex;
+    std::size_t                             m_BufferOffset;
+    std::size_t                             m_BytesWritten;
+
+    /* Handler of the write in progress. */
+    WriteHandler                            m_Handler;
+
+    /* True while AsyncWrite() runs, the handler is posted then instead of being called inside it. */
+    bool                                    m_IsInsideAsyncWrite;
+
+    /* True from AsyncWrite() till HoldUntilCompleted(), the completions are not reaped before they can be matched to the batch. */
+    bool                                    m_IsWriteUnheld;
+
+    /* Number that the kernel gives to the next sendmsg() call that sends data. */
+    uint32_t                                m_NextID;
+
+    /* Number of the first call of the write in progress, or of the last write till it is held. */
+    uint32_t                                m_WriteFirstID;
+
+    /* Batches that the kernel may still send from, oldest first. */
+    std::deque<HeldBatch>                   m_HeldBatches;
+
+    /* Emptied vectors of the released batches, reused for the next batches. */
+    std::vector<std::vector<SharedPayload>> m_SpareBatches;
+};
+
+END_NAMESPACE_TCP
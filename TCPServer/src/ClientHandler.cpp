@@ -1,50 +1,173 @@
 #include "ClientHandler.h"
+#include "ReadBufferPool.h"
+#include "TCPCommon/HandlerAllocator.h"
 
 using boost::asio::ip::tcp;
 
 BEGIN_NAMESPACE_TCP
 
+/* Number of consecutive full reads after which the read buffer is grown. */
+static constexpr uint32_t NumFullReadsToGrow = 2;
+
+/* Number of consecutive small reads after which the read buffer is shrunk. */
+static constexpr uint32_t NumSmallReadsToShrink = 16;
+
 // private
 ClientHandler::ClientHandler(
     boost::asio::ip::tcp::socket socket,
-    uint32_t id,
-    OnDataReceivedCallback cb_OnDataReceived,
-    OnDataReceivedErrorCallback cb_OnDataReceivedError,
-    OnClientDisconnectedCallback cb_OnClientDisconnected
+    ClientID id,
+    const ServerConfig& config,
+    const ClientHandlerCallbacks& callbacks,
+    ServerStats& stats
     )
     : m_BytesRead(0)
-    , m_ReadBuffer(1 * 1024)
+    , m_ReadBufferMinSize(std::max<std::size_t>(config.ReadBufferMinSize, 1))
+    , m_ReadBufferMaxSize(std::max(m_ReadBufferMinSize, config.ReadBufferMaxSize))
+    , m_UseSharedReadBuffers(config.UseSharedReadBuffers)
+    , m_ReadDrainMaxBytes(config.ReadDrainMaxBytes)
+    , m_ReadDrainMaxReads(std::max<uint32_t>(config.ReadDrainMaxReads, 1))
+    , m_ReadBuffer(m_UseSharedReadBuffers ? 0 : std::clamp(config.ReadBufferInitialSize, m_ReadBufferMinSize, m_ReadBufferMaxSize))
+    , m_UseReceiveTimestamps(config.UseReceiveTimestamps)
+    , m_IsLastReceiveTimestampFromKernel(false)
+    , m_NumFullReads(0)
+    , m_NumSmallReads(0)
     , m_Socket(std::move(socket))
+    , m_IsDisconnected(false)
+    , m_IsClosed(false)
+    , m_OutboundQueue(config.BulkBatchMaxBytes)
+    , m_WriteInProgress(false)
+    , m_CoalesceWrites(config.CoalesceWrites)
+    , m_WriteCoalescingDelay(std::max(config.WriteCoalescingDelay, std::chrono::microseconds::zero()))
+    , m_WriteCoalescingMaxBytes(config.WriteCoalescingMaxBytes)
+    , m_MaxOutboundBytes(config.MaxOutboundBytes)
+    , m_OutboundLimitPolicy(config.OutboundLimitPolicy)
+    , m_OutboundHighWatermark(config.OutboundHighWatermark)
+    , m_OutboundLowWatermark(std::min(config.OutboundLowWatermark, config.OutboundHighWatermark))
+    , m_IsAboveOutboundHighWatermark(false)
+    , m_ZeroCopyThreshold(config.ZeroCopyThreshold)
+    , m_IsWaitingForZeroCopyCompletions(false)
+    , m_IsFlushScheduled(false)
     , m_ID(id)
-    , m_OnDataReceivedCallback(cb_OnDataReceived)
-    , m_OnDataReceivedErrorCallback(cb_OnDataReceivedError)
-    , m_OnClientDisconnectedCallback(cb_OnClientDisconnected)
+    , m_Callbacks(callbacks)
+    , m_Stats(stats)
+    , m_ShardIndex(ClientRegistry::GetShardIndex(id))
+    , m_IsReading(false)
+    , m_IsReadPausedByUser(false)
+    , m_IsReadPausedByWatermark(false)
+    , m_InboundHighWatermark(config.InboundHighWatermark)
+    , m_InboundLowWatermark(std::min(config.InboundLowWatermark, config.InboundHighWatermark))
+    , m_InboundQueuedBytes(0)
+    , m_Protocols(config.Protocols)
+    , m_ProtocolIndex(NoProtocol)
+    , m_SniffedBytes(0)
+    , m_IsSniffing(!config.Protocols.empty())
+{
+    // framed reads can go into a mirrored ring buffer instead, so that split messages are parsed in place.
+    if (config.UseMirroredReadBuffer && config.Framing.Mode != FramingMode::None && !m_UseSharedReadBuffers && !m_IsSniffing)
+    {
+        m_ReadRing = std::make_unique<MirroredRingBuffer>();
+        if (boost::system::error_code ec = m_ReadRing->Allocate(m_ReadBufferMaxSize))
+        {
+            // e.g. vm.max_map_count or the fd limit is reached, the client still works with the copying read buffer.
+            printf("\nCould not map the mirrored read buffer of %s, its reads are copied instead : %s",
+                GetInfoString().c_str(), ec.message().c_str());
+            m_Stats.OnMirroredReadBufferFallback();
+            m_ReadRing.reset();
+        }
+        else
+        {
+            std::vector<uint8_t>().swap(m_ReadBuffer);
+        }
+    }
+
+    // pooled buffers are not owned by the client, so they are not counted in the stats.
+    if (!m_UseSharedReadBuffers)
+        m_Stats.OnReadBufferAllocated(GetOwnedReadBufferSize());
+
+    // the synchronous reads of the idle, drain and timestamp modes must return would_block instead of waiting for data.
+    if (m_UseSharedReadBuffers || m_ReadDrainMaxBytes || m_UseReceiveTimestamps)
+        m_Socket.non_blocking(true);
+
+    if (m_UseReceiveTimestamps)
+    {
+        // the reads still time the deliveries, only the queueing delays are not known without the kernel's stamps.
+        if (boost::system::error_code ec = EnableReceiveTimestamps(m_Socket))
+        {
+            printf("\nCould not enable the receive timestamps of %s, its queueing delays are not recorded : %s",
+                GetInfoString().c_str(), ec.message().c_str());
+            m_Stats.OnReceiveTimestampFallback();
+        }
+    }
 
+    // the timer runs its handlers on the strand of the socket, like all the other handlers of the client.
+    if (m_CoalesceWrites && m_WriteCoalescingDelay.count() > 0)
+        m_FlushTimer = std::make_unique<boost::asio::steady_timer>(m_Socket.get_executor());
+
+    if (m_ZeroCopyThreshold)
+    {
+        // the large batches are still written, only copied into the socket buffer like the small ones.
+        if (boost::system::error_code ec = ZeroCopySender::Enable(m_Socket))
+        {
+            printf("\nCould not enable MSG_ZEROCOPY on %s, its writes are copied instead : %s",
+                GetInfoString().c_str(), ec.message().c_str());
+            m_Stats.OnZeroCopyFallback();
+        }
+        else
+        {
+            m_ZeroCopySender = std::make_unique<ZeroCopySender>(m_Socket, m_Stats);
+        }
+    }
+
+    // with protocol sniffing, the framing is only known once the protocol is detected.
+    if (!m_IsSniffing)
+        CreateFrameAssembler(config.Framing);
+}
+
+// private
+void ClientHandler::CreateFrameAssembler(const FramingOptions& framing)
 {
+    if (framing.Mode != FramingMode::None)
+    {
+        FrameStreamCallbacks streamCallbacks;
+        streamCallbacks.OnBegin = [this](uint64_t size) { m_Callbacks.OnMessageBegin(GetID(), size); };
+        streamCallbacks.OnChunk = [this](std::span<const uint8_t> chunk) { m_Callbacks.OnMessageChunk(GetID(), chunk); };
+        streamCallbacks.OnEnd = [this]() { m_Callbacks.OnMessageEnd(GetID()); };
+
+        m_FrameAssembler = std::make_unique<FrameAssembler>(framing,
+            [this](std::span<const uint8_t> message)
+            {
+                m_Callbacks.OnMessage(GetID(), message);
+            },
+            std::move(streamCallbacks));
+    }
 }
 
 // public
 ClientHandler::~ClientHandler()
 {
+    if (!m_UseSharedReadBuffers)
+        m_Stats.OnReadBufferReleased(GetOwnedReadBufferSize());
+    CountOutboundReleased(m_OutboundQueue.GetTotalBytes());
     m_Socket.close();
 }
 
 // public static
 ClientHandlerSPtr ClientHandler::Create(
     boost::asio::ip::tcp::socket socket,
-    uint32_t id,
-    OnDataReceivedCallback cb_OnDataReceived,
-    OnDataReceivedErrorCallback cb_OnDataReceivedError,
-    OnClientDisconnectedCallback cb_OnClientDisconnected
+    ClientID id,
+    const ServerConfig& config,
+    const ClientHandlerCallbacks& callbacks,
+    ServerStats& stats
 )
 {
-    return std::make_shared<ClientHandler>(std::move(socket), id, cb_OnDataReceived, cb_OnDataReceivedError, cb_OnClientDisconnected);
+    return std::make_shared<ClientHandler>(std::move(socket), id, config, callbacks, stats);
 }
 
 // public
 bool ClientHandler::IsConnected() const
 {
-    return m_Socket.is_open();
+    // the socket is only closed by the destructor, so reading its state does not race with the strand.
+    return !m_IsClosed.load(std::memory_order_acquire) && m_Socket.is_open();
 }
 
 // public
@@ -53,32 +176,421 @@ void ClientHandler::ScheduleRead()
     if (!IsConnected())
         return;
 
-    m_Socket.async_read_some(boost::asio::buffer(m_ReadBuffer.data(), m_ReadBuffer.size()),
-        [this](const boost::system::error_code& ec, std::size_t bytesRead)
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this()]()
+        {
+            if (!self->m_IsReading)
+                self->DoRead();
+        }));
+}
+
+// public
+void ClientHandler::PauseReading()
+{
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this()]()
+        {
+            self->m_IsReadPausedByUser = true;
+        }));
+}
+
+// public
+void ClientHandler::ResumeReading()
+{
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this()]()
         {
-            // check if the client disconnected from the server.
-            if (ec == boost::asio::error::eof)
+            self->m_IsReadPausedByUser = false;
+            self->RestartReading();
+        }));
+}
+
+// public
+void ClientHandler::ReportInboundQueued(std::size_t bytes)
+{
+    std::size_t queuedBytes = m_InboundQueuedBytes.fetch_add(bytes) + bytes;
+
+    // only crossing a watermark can change the state, it is then evaluated again on the strand.
+    if (m_InboundHighWatermark && queuedBytes > m_InboundHighWatermark && queuedBytes - bytes <= m_InboundHighWatermark)
+    {
+        boost::asio::dispatch(m_Socket.get_executor(),
+            BindRecyclingAllocator([self = shared_from_this()]()
             {
-                m_OnClientDisconnectedCallback(GetID());
-                //m_Server->OnClientDisconnected(GetID());
+                self->UpdateInboundFlowControl();
+            }));
+    }
+}
+
+// public
+void ClientHandler::ReportInboundConsumed(std::size_t bytes)
+{
+    std::size_t previousBytes = m_InboundQueuedBytes.fetch_sub(bytes);
+    std::size_t queuedBytes = previousBytes - bytes;
+
+    if (m_InboundHighWatermark && queuedBytes <= m_InboundLowWatermark && previousBytes > m_InboundLowWatermark)
+    {
+        boost::asio::dispatch(m_Socket.get_executor(),
+            BindRecyclingAllocator([self = shared_from_this()]()
+            {
+                self->UpdateInboundFlowControl();
+            }));
+    }
+}
+
+// private
+void ClientHandler::UpdateInboundFlowControl()
+{
+    std::size_t queuedBytes = m_InboundQueuedBytes;
+
+    if (!m_IsReadPausedByWatermark && queuedBytes > m_InboundHighWatermark)
+    {
+        m_IsReadPausedByWatermark = true;
+    }
+    else if (m_IsReadPausedByWatermark && queuedBytes <= m_InboundLowWatermark)
+    {
+        m_IsReadPausedByWatermark = false;
+        RestartReading();
+    }
+}
+
+// private
+void ClientHandler::RestartReading()
+{
+    // a read that is still in flight continues the reading by itself.
+    if (!m_IsReading && !IsReadPaused())
+        DoRead();
+}
+
+// private
+void ClientHandler::DoRead()
+{
+    if (!IsConnected())
+        return;
+
+    // the next read is started by RestartReading(), once reading is not paused anymore.
+    m_IsReading = !IsReadPaused();
+    if (!m_IsReading)
+        return;
+
+    // the timestamps are only returned by recvmsg(), so the read waits for the data and then reads it itself.
+    if (m_UseSharedReadBuffers || m_UseReceiveTimestamps)
+    {
+        DoWaitForRead();
+        return;
+    }
+
+    boost::asio::mutable_buffer target = GetReadTarget();
+    m_Socket.async_read_some(target,
+        BindRecyclingAllocator([this, self = shared_from_this(), bufferSize = target.size()](const boost::system::error_code& ec, std::size_t bytesRead)
+        {
+            if (!OnReadCompleted(ec, bytesRead))
                 return;
-            }
 
-            // check if any errorneous data(according to boost::asio) is received from the client.
+            AdaptReadBufferSize(bytesRead);
+
+            /* Assign the context with another read task. */
+            ContinueReading(DrainReads(bytesRead, bufferSize));
+        }));
+}
+
+// private
+void ClientHandler::DoWaitForRead()
+{
+    m_Socket.async_wait(boost::asio::socket_base::wait_read,
+        BindRecyclingAllocator([this, self = shared_from_this()](const boost::system::error_code& ec)
+        {
             if (ec)
             {
-                m_OnDataReceivedErrorCallback(GetID(), ec);
-                //m_Server->OnDataReceivedError(GetID(), ec);
+                ReportDisconnected(ec);
                 return;
             }
 
-            m_BytesRead = bytesRead;
-            m_OnDataReceivedCallback(GetID());
-            //m_Server->OnDataReceived(GetID());
+            // the buffer is borrowed and returned within this handler, so the pool of the current thread can be used.
+            // only while the protocol is sniffed, the buffer is kept till the next read, as it holds the sniffed bytes.
+            ReadBufferPool& pool = ReadBufferPool::ForThisThread();
+            if (m_UseSharedReadBuffers && m_ReadBuffer.empty())
+                m_ReadBuffer = pool.Acquire(m_ReadBufferMaxSize);
 
-            /* Assign the context with another read task. */
-            ScheduleRead();
-        });
+            boost::system::error_code readError;
+            boost::asio::mutable_buffer target = GetReadTarget();
+            std::size_t bytesRead = ReadSome(target, readError);
+
+            // on a spurious wake up, just wait again.
+            ReadDrainResult result = ReadDrainResult::Drained;
+            if (readError != boost::asio::error::would_block)
+            {
+                result = ReadDrainResult::Stopped;
+                if (OnReadCompleted(readError, bytesRead))
+                {
+                    if (!m_UseSharedReadBuffers)
+                        AdaptReadBufferSize(bytesRead);
+
+                    result = DrainReads(bytesRead, target.size());
+                }
+            }
+
+            if (m_UseSharedReadBuffers && !m_IsSniffing)
+                pool.Release(std::move(m_ReadBuffer));
+
+            ContinueReading(result);
+        }));
+}
+
+// private
+std::size_t ClientHandler::ReadSome(boost::asio::mutable_buffer target, boost::system::error_code& ec)
+{
+    if (m_UseReceiveTimestamps)
+        return ReceiveWithTimestamp(m_Socket, target, ec, m_LastReceiveTimestamp, m_IsLastReceiveTimestampFromKernel);
+
+    return m_Socket.read_some(target, ec);
+}
+
+// private
+ClientHandler::ReadDrainResult ClientHandler::DrainReads(std::size_t bytesRead, std::size_t bufferSize)
+{
+    if (m_ReadDrainMaxBytes == 0)
+        return ReadDrainResult::Drained;
+
+    std::size_t bytesDrained = bytesRead;
+    uint32_t numReads = 1;
+
+    // a read that did not fill its buffer has most likely emptied the socket, so no extra read is wasted to find out.
+    while (bytesRead == bufferSize && IsConnected() && !IsReadPaused())
+    {
+        if (bytesDrained >= m_ReadDrainMaxBytes || numReads >= m_ReadDrainMaxReads)
+            return ReadDrainResult::BudgetExhausted;
+
+        boost::system::error_code ec;
+        boost::asio::mutable_buffer target = GetReadTarget();
+        bufferSize = target.size();
+        bytesRead = ReadSome(target, ec);
+
+        if (ec == boost::asio::error::would_block)
+            return ReadDrainResult::Drained;
+
+        if (!OnReadCompleted(ec, bytesRead))
+            return ReadDrainResult::Stopped;
+
+        if (!m_UseSharedReadBuffers)
+            AdaptReadBufferSize(bytesRead);
+
+        bytesDrained += bytesRead;
+        ++numReads;
+    }
+
+    return ReadDrainResult::Drained;
+}
+
+// private
+void ClientHandler::ContinueReading(ReadDrainResult result)
+{
+    if (result == ReadDrainResult::Stopped)
+        return;
+
+    if (result == ReadDrainResult::Drained)
+    {
+        DoRead();
+        return;
+    }
+
+    // posting puts the read behind the handlers that are already queued on the io_context.
+    boost::asio::post(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this()]()
+        {
+            self->DoRead();
+        }));
+}
+
+// private
+bool ClientHandler::OnReadCompleted(const boost::system::error_code& ec, std::size_t bytesRead)
+{
+    // check if the client disconnected from the server.
+    if (ec == boost::asio::error::eof)
+    {
+        ReportDisconnected(ec);
+        //m_Server->OnClientDisconnected(GetID());
+        return false;
+    }
+
+    // check if any errorneous data(according to boost::asio) is received from the client.
+    if (ec)
+    {
+        ReportDisconnected(ec);
+        //m_Server->OnDataReceivedError(GetID(), ec);
+        return false;
+    }
+
+    return OnDataRead(bytesRead);
+}
+
+// private
+void ClientHandler::ReportDisconnected(const boost::system::error_code& ec)
+{
+    if (m_IsDisconnected)
+        return;
+
+    m_IsDisconnected = true;
+
+    // the queued files are not sent anymore, they report back here on the strand instead of wherever the client is destroyed.
+    for (const FileTransferSPtr& file : m_OutboundQueue.TakeFiles())
+        file->Complete(boost::asio::error::operation_aborted);
+
+    if (ec == boost::asio::error::eof)
+        m_Callbacks.OnClientDisconnected(GetID());
+    else
+        m_Callbacks.OnDataReceivedError(GetID(), ec);
+}
+
+// private
+void ClientHandler::CloseSocket()
+{
+    if (m_IsClosed.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    // closing would race with the other threads, shutting down and cancelling only touch the connection.
+    boost::system::error_code ec;
+    m_Socket.shutdown(boost::asio::socket_base::shutdown_both, ec);
+    m_Socket.cancel(ec);
+}
+
+// private
+bool ClientHandler::OnDataRead(std::size_t bytesRead)
+{
+    if (m_IsSniffing)
+        return SniffProtocol(bytesRead);
+
+    if (!m_UseReceiveTimestamps)
+        return DeliverReadData(bytesRead);
+
+    ReceiveClock::time_point deliveryTime = ReceiveClock::now();
+    bool isValid = DeliverReadData(bytesRead);
+    // the time of the read is no receive time, the queueing delay would be recorded as about 0.
+    std::optional<std::chrono::nanoseconds> queueingDelay;
+    if (m_IsLastReceiveTimestampFromKernel)
+        queueingDelay = deliveryTime - m_LastReceiveTimestamp;
+
+    m_Stats.OnReceiveTimed(m_ShardIndex, queueingDelay, ReceiveClock::now() - deliveryTime);
+
+    return isValid;
+}
+
+// private
+bool ClientHandler::SniffProtocol(std::size_t bytesRead)
+{
+    m_SniffedBytes += bytesRead;
+
+    std::span<const uint8_t> sniffedBytes(m_ReadBuffer.data(), m_SniffedBytes);
+    bool isBufferFull = m_SniffedBytes == m_ReadBuffer.size();
+
+    for (std::size_t i = 0; i < m_Protocols.size(); ++i)
+    {
+        SniffResult result = m_Protocols[i].Sniff ? m_Protocols[i].Sniff(sniffedBytes) : SniffResult::NoMatch;
+
+        // a protocol that needs more data holds back the ones after it, unless no more data fits into the buffer.
+        if (result == SniffResult::NeedMoreData && !isBufferFull)
+            return true;
+
+        if (result != SniffResult::Match)
+            continue;
+
+        m_IsSniffing = false;
+        m_ProtocolIndex = i;
+        m_SniffedBytes = 0;
+        CreateFrameAssembler(m_Protocols[i].Framing);
+
+        if (!m_Callbacks.OnProtocolDetected(GetID(), i))
+        {
+            ReportDisconnected(boost::asio::error::connection_refused);
+            return false;
+        }
+
+        // the sniffed bytes are delivered in place, from the start of the read buffer.
+        return DeliverReadData(sniffedBytes.size());
+    }
+
+    ReportDisconnected(boost::asio::error::no_protocol_option);
+    return false;
+}
+
+// private
+bool ClientHandler::DeliverReadData(std::size_t size)
+{
+    m_BytesRead = size;
+
+    if (!m_FrameAssembler)
+    {
+        m_Callbacks.OnDataReceived(*this, std::span<const uint8_t>(m_ReadBuffer.data(), size));
+        //m_Server->OnDataReceived(GetID());
+        return true;
+    }
+
+    bool isValid = m_ReadRing ? FeedReadRing(size) : m_FrameAssembler->Feed(std::span<const uint8_t>(m_ReadBuffer.data(), size));
+    if (!isValid)
+    {
+        ReportDisconnected(boost::asio::error::message_size);
+        return false;
+    }
+
+    return true;
+}
+
+// private
+bool ClientHandler::FeedReadRing(std::size_t bytesRead)
+{
+    m_ReadRing->Commit(bytesRead);
+    return m_FrameAssembler->FeedRing(*m_ReadRing);
+}
+
+// private
+boost::asio::mutable_buffer ClientHandler::GetReadTarget()
+{
+    if (m_ReadRing)
+    {
+        std::span<uint8_t> freeSpace = m_ReadRing->GetWriteSpan();
+        return boost::asio::buffer(freeSpace.data(), freeSpace.size());
+    }
+
+    // while sniffing, the bytes are appended to the ones that were sniffed so far.
+    return boost::asio::buffer(m_ReadBuffer.data() + m_SniffedBytes, m_ReadBuffer.size() - m_SniffedBytes);
+}
+
+// private
+void ClientHandler::AdaptReadBufferSize(std::size_t bytesRead)
+{
+    // the ring buffer has a fixed size, and the sniffed bytes must stay in the buffer.
+    if (m_ReadRing || m_IsSniffing)
+        return;
+
+    std::size_t size = m_ReadBuffer.size();
+    std::size_t newSize = size;
+
+    if (bytesRead == size)
+    {
+        m_NumSmallReads = 0;
+        if (++m_NumFullReads >= NumFullReadsToGrow)
+            newSize = std::min(size * 2, m_ReadBufferMaxSize);
+    }
+    else if (bytesRead < size / 4)
+    {
+        m_NumFullReads = 0;
+        if (++m_NumSmallReads >= NumSmallReadsToShrink)
+            newSize = std::max(size / 2, m_ReadBufferMinSize);
+    }
+    else
+    {
+        m_NumFullReads = 0;
+        m_NumSmallReads = 0;
+    }
+
+    if (newSize == size)
+        return;
+
+    m_NumFullReads = 0;
+    m_NumSmallReads = 0;
+
+    // a new vector is used, so that the memory is actually released when shrinking.
+    std::vector<uint8_t>(newSize).swap(m_ReadBuffer);
+    m_Stats.OnReadBufferResized(size, newSize);
 }
 
 // public
@@ -87,43 +599,405 @@ void ClientHandler::Write(const std::vector<uint8_t>& buffer, std::size_t bytesT
     if (!IsConnected())
         return;
 
-    try 
+    boost::system::error_code ec;
+    std::size_t bytesWritten = 0;
+    while (!ec && bytesWritten < bytesToWrite)
     {
-        m_Socket.write_some(boost::asio::buffer(buffer.data(), bytesToWrite));
-    }
-    catch (std::exception& e)
-    {
-        printf("\n%s", e.what());
+        bytesWritten += m_Socket.write_some(boost::asio::buffer(buffer.data() + bytesWritten, bytesToWrite - bytesWritten), ec);
+
+        // the idle, drain and timestamp modes make the socket non-blocking, so a full send buffer is waited out here like
+        // a blocking send would. basic_socket::wait() cannot do it, it does not wait on a non-blocking socket either.
+        if (ec == boost::asio::error::would_block)
+            boost::asio::detail::socket_ops::poll_write(m_Socket.native_handle(), 0, -1, ec);
     }
+
+    if (ec)
+        printf("\nError Writing to %s : %s", GetInfoString().c_str(), ec.message().c_str());
 }
 
 // public
 void ClientHandler::ScheduleWrite(const std::vector<uint8_t>& buffer, std::size_t bytesToWrite)
 {
+    ScheduleWrite(SharedPayload::Copy(buffer.data(), bytesToWrite));
+}
+
+// public
+void ClientHandler::ScheduleWrite(const SharedPayload& payload, MessagePriority priority)
+{
+    if (!IsConnected() || payload.IsEmpty())
+        return;
+
+    // the outbound queue and the socket must only be used from the client's strand.
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this(), payload, priority]()
+        {
+            self->QueueWrite(payload, priority);
+        }));
+}
+
+// public
+void ClientHandler::ScheduleConflatedWrite(ConflationKey key, const SharedPayload& payload)
+{
+    if (!IsConnected() || payload.IsEmpty())
+        return;
+
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this(), key, payload]()
+        {
+            self->QueueWrite(payload, MessagePriority::Bulk, key);
+        }));
+}
+
+// public
+void ClientHandler::ScheduleBroadcastWrite(const SharedPayload& payload, MessagePriority priority,
+    std::optional<ConflationKey> key)
+{
+    if (!IsConnected() || payload.IsEmpty())
+        return;
+
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([this, payload, priority, key]()
+        {
+            QueueWrite(payload, priority, key);
+        }));
+}
+
+// public
+void ClientHandler::ScheduleSendFile(FileTransferSPtr file)
+{
+    if (!file)
+        return;
+
+    // a file for a client that is gone is completed on the strand as well, like any other file.
+    boost::asio::dispatch(m_Socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this(), file = std::move(file)]() mutable
+        {
+            if (!self->IsConnected() || self->m_IsDisconnected)
+            {
+                file->Complete(boost::asio::error::operation_aborted);
+                return;
+            }
+
+            self->m_OutboundQueue.PushFile(std::move(file));
+            self->OnWriteQueued(MessagePriority::Bulk);
+        }));
+}
+
+// private
+void ClientHandler::QueueWrite(const SharedPayload& payload, MessagePriority priority, std::optional<ConflationKey> key)
+{
+    // the client may have been disconnected since the write was scheduled.
     if (!IsConnected())
         return;
 
-    m_Socket.async_write_some(boost::asio::buffer(buffer.data(), bytesToWrite),
-        [this, buffer](const boost::system::error_code& ec, std::size_t bytesWritten)
+    // a message that replaces a queued one only adds the difference of their sizes.
+    std::size_t replacedBytes = key ? m_OutboundQueue.GetConflatedSize(*key) : 0;
+    if (m_MaxOutboundBytes && m_OutboundQueue.GetTotalBytes() - replacedBytes + payload.Size() > m_MaxOutboundBytes)
+    {
+        if (!ApplyOutboundLimit(payload, key))
+            return;
+    }
+
+    if (key)
+    {
+        SharedPayload replaced = m_OutboundQueue.PushConflated(payload, *key);
+        if (!replaced.IsEmpty())
         {
+            CountOutboundReleased(replaced.Size());
+            m_Stats.OnOutboundConflated(replaced.Size());
+        }
+    }
+    else
+    {
+        m_OutboundQueue.Push(payload, priority);
+    }
+
+    CountOutboundQueued(payload.Size());
+
+    UpdateOutboundWatermarks();
+    OnWriteQueued(priority);
+}
+
+// private
+bool ClientHandler::ApplyOutboundLimit(const SharedPayload& payload, std::optional<ConflationKey> key)
+{
+    m_Callbacks.OnClientBackpressure(GetID(), m_OutboundQueue.GetTotalBytes());
+
+    // the callback may have disconnected the client.
+    if (!IsConnected())
+        return false;
+
+    switch (m_OutboundLimitPolicy)
+    {
+    case SlowConsumerPolicy::Notify:
+        return true;
+
+    case SlowConsumerPolicy::DropOldest:
+    {
+        // the message that is about to be replaced is kept, so only the difference of their sizes has to be freed.
+        std::size_t replacedBytes = key ? m_OutboundQueue.GetConflatedSize(*key) : 0;
+        std::size_t queuedBytes = m_OutboundQueue.GetQueuedBytes();
+        std::size_t bytesToFree = m_OutboundQueue.GetTotalBytes() - replacedBytes + payload.Size() - m_MaxOutboundBytes;
+        std::size_t numDropped = m_OutboundQueue.DropOldest(bytesToFree, key);
+
+        std::size_t bytesDropped = queuedBytes - m_OutboundQueue.GetQueuedBytes();
+        CountOutboundReleased(bytesDropped);
+        m_Stats.OnOutboundDropped(numDropped, bytesDropped);
+
+        // the batch in flight cannot be dropped, so the message may still not fit.
+        if (m_OutboundQueue.GetTotalBytes() - replacedBytes + payload.Size() <= m_MaxOutboundBytes)
+            return true;
+
+        m_Stats.OnOutboundDropped(1, payload.Size());
+        UpdateOutboundWatermarks();
+        return false;
+    }
+
+    case SlowConsumerPolicy::Disconnect:
+    {
+        m_Stats.OnSlowConsumerDisconnected();
+        ReportDisconnected(boost::asio::error::no_buffer_space);
+
+        // the pending read would keep the client alive till the peer sends something.
+        CloseSocket();
+        return false;
+    }
+
+    case SlowConsumerPolicy::DropNewest:
+    default:
+        m_Stats.OnOutboundDropped(1, payload.Size());
+        return false;
+    }
+}
+
+// private
+void ClientHandler::UpdateOutboundWatermarks()
+{
+    if (!m_OutboundHighWatermark)
+        return;
+
+    std::size_t queuedBytes = m_OutboundQueue.GetTotalBytes();
+
+    if (!m_IsAboveOutboundHighWatermark && queuedBytes > m_OutboundHighWatermark)
+    {
+        m_IsAboveOutboundHighWatermark = true;
+        m_Callbacks.OnOutboundHighWatermark(GetID(), queuedBytes);
+    }
+    else if (m_IsAboveOutboundHighWatermark && queuedBytes <= m_OutboundLowWatermark)
+    {
+        m_IsAboveOutboundHighWatermark = false;
+        m_Callbacks.OnOutboundLowWatermark(GetID(), queuedBytes);
+    }
+}
+
+// private
+void ClientHandler::CountOutboundQueued(std::size_t size)
+{
+    if (m_MaxOutboundBytes || m_OutboundHighWatermark)
+        m_Stats.OnOutboundQueued(m_ShardIndex, size);
+}
+
+// private
+void ClientHandler::CountOutboundReleased(std::size_t size)
+{
+    if (m_MaxOutboundBytes || m_OutboundHighWatermark)
+        m_Stats.OnOutboundReleased(m_ShardIndex, size);
+}
+
+// private
+void ClientHandler::OnWriteQueued(MessagePriority priority)
+{
+    // the completion of the write in flight writes the queued messages with the next batch.
+    if (m_WriteInProgress)
+        return;
+
+    if (!m_CoalesceWrites || priority == MessagePriority::Control || m_OutboundQueue.GetQueuedBytes() >= m_WriteCoalescingMaxBytes)
+    {
+        DoWrite();
+        return;
+    }
+
+    ScheduleFlush();
+}
+
+// private
+void ClientHandler::ScheduleFlush()
+{
+    if (m_IsFlushScheduled)
+        return;
+
+    m_IsFlushScheduled = true;
+
+    if (!m_FlushTimer)
+    {
+        // posting to the strand runs the flush after the handler that is running, and the ones already queued behind it.
+        boost::asio::post(m_Socket.get_executor(),
+            BindRecyclingAllocator([self = shared_from_this()]()
+            {
+                self->Flush();
+            }));
+        return;
+    }
+
+    m_FlushTimer->expires_after(m_WriteCoalescingDelay);
+    m_FlushTimer->async_wait(
+        BindRecyclingAllocator([self = shared_from_this()](const boost::system::error_code&)
+        {
+            self->Flush();
+        }));
+}
+
+// private
+void ClientHandler::Flush()
+{
+    m_IsFlushScheduled = false;
+
+    // the queue may have been written already, when it reached WriteCoalescingMaxBytes before the delay ran out.
+    if (!m_WriteInProgress)
+        DoWrite();
+}
+
+// private
+void ClientHandler::DoWrite()
+{
+    if (!IsConnected() || m_OutboundQueue.IsEmpty())
+    {
+        m_WriteInProgress = false;
+        return;
+    }
+
+    m_WriteInProgress = true;
+
+    if (m_OutboundQueue.IsFileNext())
+    {
+        DoSendFile(m_OutboundQueue.PopFile());
+        return;
+    }
+
+    std::span<const boost::asio::const_buffer> batch = m_OutboundQueue.PrepareBatch();
+    if (m_ZeroCopySender && m_OutboundQueue.GetInFlightBytes() >= m_ZeroCopyThreshold)
+    {
+        DoZeroCopyWrite(batch);
+        return;
+    }
+
+    // async_write keeps writing till every byte of the batch is written.
+    boost::asio::async_write(m_Socket, batch,
+        BindRecyclingAllocator([this, self = shared_from_this()](const boost::system::error_code& ec, std::size_t)
+        {
+            CountOutboundReleased(m_OutboundQueue.GetInFlightBytes());
+            m_OutboundQueue.CompleteBatch();
+            UpdateOutboundWatermarks();
+
+            if (ec)
+            {
+                OnWriteFailed(ec);
+                return;
+            }
+
+            /* Write the messages that were queued while this batch was in flight. */
+            DoWrite();
+        }));
+}
+
+// private
+void ClientHandler::DoZeroCopyWrite(std::span<const boost::asio::const_buffer> batch)
+{
+    m_ZeroCopySender->AsyncWrite(batch,
+        [this, self = shared_from_this()](const boost::system::error_code& ec, std::size_t)
+        {
+            // the kernel may still read from the payloads, so they are held instead of released.
+            CountOutboundReleased(m_OutboundQueue.GetInFlightBytes());
+            m_ZeroCopySender->HoldUntilCompleted(m_OutboundQueue.TakeBatch(m_ZeroCopySender->TakeSpareBatch()));
+            UpdateOutboundWatermarks();
+            WaitForZeroCopyCompletions();
+
             if (ec)
             {
-                printf("\nError Writing to %s.", GetInfoString().c_str());
+                OnWriteFailed(ec);
                 return;
             }
-            else
+
+            /* Write the messages that were queued while this batch was in flight. */
+            DoWrite();
+        });
+}
+
+// private
+void ClientHandler::OnWriteFailed(const boost::system::error_code& ec)
+{
+    printf("\nError Writing to %s : %s", GetInfoString().c_str(), ec.message().c_str());
+    m_WriteInProgress = false;
+
+    CountOutboundReleased(m_OutboundQueue.GetQueuedBytes());
+    m_OutboundQueue.ClearMessages();
+    UpdateOutboundWatermarks();
+
+    // the files are aborted here as well, the read side may have reported the disconnection already.
+    for (const FileTransferSPtr& file : m_OutboundQueue.TakeFiles())
+        file->Complete(boost::asio::error::operation_aborted);
+
+    ReportDisconnected(ec);
+    CloseSocket();
+}
+
+// private
+void ClientHandler::WaitForZeroCopyCompletions()
+{
+    if (!IsConnected())
+        return;
+
+    if (!m_IsWaitingForZeroCopyCompletions && m_ZeroCopySender->GetNumHeldBatches() > 0)
+    {
+        m_IsWaitingForZeroCopyCompletions = true;
+
+        // the completions are queued on the error queue of the socket, which reports them as an error condition.
+        m_Socket.async_wait(boost::asio::socket_base::wait_error,
+            BindRecyclingAllocator([weakSelf = weak_from_this()](const boost::system::error_code& ec)
+            {
+                ClientHandlerSPtr self = weakSelf.lock();
+                if (!self)
+                    return;
+
+                self->m_IsWaitingForZeroCopyCompletions = false;
+                if (!ec)
+                    self->WaitForZeroCopyCompletions();
+            }));
+    }
+
+    // reaped only once the wait is armed. The socket reports the error condition once per change, edge triggered, and
+    // another thread of the io_context may take that report, so a completion that came before the wait would be missed.
+    m_ZeroCopySender->ReapCompletions();
+}
+
+// private
+void ClientHandler::DoSendFile(FileTransferSPtr file)
+{
+    // the transfer calls its completion callback itself, the handler does not hold it so that it does not own itself.
+    file->AsyncSend(m_Socket,
+        [this, self = shared_from_this()](const boost::system::error_code& ec)
+        {
+            if (ec)
             {
-                std::string message(buffer.begin(), buffer.end());
-                printf("\nMessage Sent to %s. : %s", GetInfoString().c_str(), message.c_str());
+                printf("\nError Sending a file to %s : %s", GetInfoString().c_str(), ec.message().c_str());
+                m_WriteInProgress = false;
+                return;
             }
+
+            /* Write the messages and files that were queued while the file was sent. */
+            DoWrite();
         });
 }
 
 // public
 std::string ClientHandler::GetInfoString() const
 {
-    std::string ip = m_Socket.remote_endpoint().address().to_string();
-    int port = m_Socket.remote_endpoint().port();
+    // the endpoint is not available anymore once the socket is closed, so the error code overload is used.
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::endpoint endpoint = m_Socket.remote_endpoint(ec);
+
+    std::string ip = endpoint.address().to_string();
+    int port = endpoint.port();
 
     return std::format("[{}] {}({})", GetID(), ip, port);
 }
@@ -0,0 +1,92 @@
+#include "ClientRegistry.h"
+
+BEGIN_NAMESPACE_TCP
+
+// public
+ClientRegistry::ClientRegistry(uint32_t shardIndex)
+    : m_ShardIndex(shardIndex)
+{
+}
+
+// public
+ClientID ClientRegistry::Insert(const std::function<ClientHandlerSPtr(ClientID)>& createClient)
+{
+    uint32_t slotIndex;
+    if (!m_FreeSlots.empty())
+    {
+        slotIndex = m_FreeSlots.back();
+        m_FreeSlots.pop_back();
+    }
+    else
+    {
+        slotIndex = static_cast<uint32_t>(m_Slots.size());
+        m_Slots.push_back(Slot{ 1, InvalidIndex });
+    }
+
+    Slot& slot = m_Slots[slotIndex];
+    ClientID ID = MakeID(slotIndex, slot.Generation);
+
+    slot.DenseIndex = static_cast<uint32_t>(m_Clients.size());
+    m_Clients.push_back(createClient(ID));
+    m_IDs.push_back(ID);
+
+    return ID;
+}
+
+// public
+ClientHandlerSPtr ClientRegistry::Remove(ClientID ID)
+{
+    if (!Find(ID))
+        return nullptr;
+
+    Slot& slot = m_Slots[GetSlotIndex(ID)];
+    ClientHandlerSPtr removedClient = std::move(m_Clients[slot.DenseIndex]);
+
+    // move the last client into the hole, to keep the clients densely packed.
+    uint32_t lastIndex = static_cast<uint32_t>(m_Clients.size() - 1);
+    if (slot.DenseIndex != lastIndex)
+    {
+        m_Clients[slot.DenseIndex] = std::move(m_Clients[lastIndex]);
+        m_IDs[slot.DenseIndex] = m_IDs[lastIndex];
+        m_Slots[GetSlotIndex(m_IDs[slot.DenseIndex])].DenseIndex = slot.DenseIndex;
+    }
+    m_Clients.pop_back();
+    m_IDs.pop_back();
+
+    // bump the generation, so that the stale ID is rejected once the slot is reused. Generation 0 is never used.
+    slot.DenseIndex = InvalidIndex;
+    slot.Generation = (slot.Generation + 1) & ((1u << GenerationBits) - 1);
+    if (slot.Generation == 0)
+        slot.Generation = 1;
+
+    m_FreeSlots.push_back(GetSlotIndex(ID));
+
+    return removedClient;
+}
+
+// public
+const ClientHandlerSPtr* ClientRegistry::Find(ClientID ID) const
+{
+    if (GetShardIndex(ID) != m_ShardIndex)
+        return nullptr;
+
+    uint32_t slotIndex = GetSlotIndex(ID);
+    if (slotIndex >= m_Slots.size())
+        return nullptr;
+
+    const Slot& slot = m_Slots[slotIndex];
+    if (slot.DenseIndex == InvalidIndex || slot.Generation != GetGeneration(ID))
+        return nullptr;
+
+    return &m_Clients[slot.DenseIndex];
+}
+
+// private
+ClientID ClientRegistry::MakeID(uint32_t slotIndex, uint32_t generation) const
+{
+    return (static_cast<ClientID>(m_ShardIndex) << ShardShift)
+        | (static_cast<ClientID>(generation) << IndexBits)
+        | slotIndex;
+}
+
+END_NAMESPACE_TCP
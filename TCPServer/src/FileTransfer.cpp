@@ -0,0 +1,329 @@
+#include "FileTransfer.h"
+#include "TCPCommon/HandlerAllocator.h"
+
+#if defined(_WIN32)
+    #include <mswsock.h>
+    #pragma comment(lib, "Mswsock.lib")
+#else
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #if defined(__linux__)
+        #include <sys/sendfile.h>
+    #endif
+#endif
+
+BEGIN_NAMESPACE_TCP
+
+#if defined(_WIN32)
+/* Largest number of bytes that a single TransmitFile() call accepts. */
+static constexpr uint64_t MaxSendChunkSize = 2147483646;
+#else
+/* Largest number of bytes sent in one go, the transfer then yields its strand to the other handlers of the client. */
+static constexpr uint64_t MaxSendChunkSize = 1024 * 1024;
+
+/* Size of the buffer that the file is read through, where the kernel cannot send from the file directly. */
+static constexpr std::size_t ChunkBufferSize = 64 * 1024;
+#endif
+
+// private
+FileTransfer::FileTransfer(NativeHandle file, bool ownsFile, uint64_t offset, uint64_t length, OnFileSentCallback onSent)
+    : m_File(file)
+    , m_OwnsFile(ownsFile)
+    , m_Offset(offset)
+    , m_Remaining(length)
+    , m_BytesSent(0)
+    , m_OnSent(std::move(onSent))
+{
+}
+
+// public
+FileTransfer::~FileTransfer()
+{
+    // a transfer that was dropped with its client, e.g. because the server stopped, still reports back.
+    Complete(boost::asio::error::operation_aborted);
+
+    if (m_OwnsFile)
+        CloseFile(m_File);
+}
+
+// public static
+FileTransferSPtr FileTransfer::Open(const std::string& path, uint64_t offset, uint64_t length, OnFileSentCallback onSent)
+{
+#if defined(_WIN32)
+    NativeHandle file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        printf("\nCould not open %s (%lu)", path.c_str(), GetLastError());
+        return nullptr;
+    }
+#else
+    NativeHandle file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        printf("\nCould not open %s (%d)", path.c_str(), errno);
+        return nullptr;
+    }
+#endif
+
+    return Create(file, true, offset, length, std::move(onSent));
+}
+
+// public static
+FileTransferSPtr FileTransfer::FromNativeHandle(NativeHandle file, uint64_t offset, uint64_t length, OnFileSentCallback onSent)
+{
+    return Create(file, false, offset, length, std::move(onSent));
+}
+
+// private static
+FileTransferSPtr FileTransfer::Create(NativeHandle file, bool ownsFile, uint64_t offset, uint64_t length, OnFileSentCallback onSent)
+{
+    int64_t fileSize = GetFileSize(file);
+    if (fileSize < 0 || offset > static_cast<uint64_t>(fileSize) || length > static_cast<uint64_t>(fileSize) - offset)
+    {
+        printf("\nThe range [%" PRIu64 ", +%" PRIu64 ") is not inside the file", offset, length);
+        if (ownsFile)
+            CloseFile(file);
+        return nullptr;
+    }
+
+    if (length == 0)
+        length = static_cast<uint64_t>(fileSize) - offset;
+
+    // the constructor is private, so make_shared cannot be used.
+    return FileTransferSPtr(new FileTransfer(file, ownsFile, offset, length, std::move(onSent)));
+}
+
+// public
+void FileTransfer::AsyncSend(boost::asio::ip::tcp::socket& socket, SendHandler handler)
+{
+    m_SendHandler = std::move(handler);
+
+#if defined(__linux__)
+    // sendfile() must return EAGAIN instead of blocking the strand, asio keeps its own synchronous calls blocking.
+    boost::system::error_code ec;
+    socket.native_non_blocking(true, ec);
+    if (ec)
+    {
+        Finish(socket, ec);
+        return;
+    }
+#elif !defined(_WIN32)
+    m_ChunkBuffer.resize(static_cast<std::size_t>(std::min<uint64_t>(m_Remaining, ChunkBufferSize)));
+#endif
+
+    SendNext(socket);
+}
+
+// public
+void FileTransfer::Complete(const boost::system::error_code& ec)
+{
+    // moved out first, so that the callback is called only once.
+    OnFileSentCallback onSent = std::move(m_OnSent);
+    m_OnSent = nullptr;
+
+    if (onSent)
+        onSent(ec, m_BytesSent);
+}
+
+#if defined(__linux__)
+
+// private
+void FileTransfer::SendNext(boost::asio::ip::tcp::socket& socket)
+{
+    uint64_t bytesToSend = std::min(m_Remaining, MaxSendChunkSize);
+
+    while (bytesToSend)
+    {
+        off_t offset = static_cast<off_t>(m_Offset);
+        ssize_t bytesSent = sendfile(socket.native_handle(), m_File, &offset, static_cast<std::size_t>(bytesToSend));
+
+        if (bytesSent < 0 && errno == EINTR)
+            continue;
+
+        if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            socket.async_wait(boost::asio::socket_base::wait_write,
+                BindRecyclingAllocator([self = shared_from_this(), &socket](const boost::system::error_code& ec)
+                {
+                    if (ec)
+                        self->Finish(socket, ec);
+                    else
+                        self->SendNext(socket);
+                }));
+            return;
+        }
+
+        if (bytesSent < 0)
+        {
+            Finish(socket, boost::system::error_code(errno, boost::asio::error::get_system_category()));
+            return;
+        }
+
+        // the file got shorter since the transfer was created.
+        if (bytesSent == 0)
+        {
+            Finish(socket, boost::asio::error::eof);
+            return;
+        }
+
+        Advance(static_cast<std::size_t>(bytesSent));
+        bytesToSend -= static_cast<uint64_t>(bytesSent);
+    }
+
+    if (m_Remaining == 0)
+    {
+        Finish(socket, boost::system::error_code());
+        return;
+    }
+
+    // a whole chunk was sent, the other handlers of the client get their turn before the next one.
+    boost::asio::post(socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this(), &socket]()
+        {
+            self->SendNext(socket);
+        }));
+}
+
+#elif defined(_WIN32)
+
+// private
+void FileTransfer::SendNext(boost::asio::ip::tcp::socket& socket)
+{
+    if (m_Remaining == 0)
+    {
+        Finish(socket, boost::system::error_code());
+        return;
+    }
+
+    DWORD bytesToSend = static_cast<DWORD>(std::min(m_Remaining, MaxSendChunkSize));
+
+    // the completion is delivered through the io_context, like that of any other asynchronous operation on the socket.
+    boost::asio::windows::overlapped_ptr overlapped(socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this(), &socket](const boost::system::error_code& ec, std::size_t bytesSent)
+        {
+            if (!ec && bytesSent == 0)
+            {
+                self->Finish(socket, boost::asio::error::eof);
+                return;
+            }
+
+            if (ec)
+            {
+                self->Finish(socket, ec);
+                return;
+            }
+
+            self->Advance(bytesSent);
+            self->SendNext(socket);
+        }));
+
+    // TransmitFile() reads the file from the offset in the OVERLAPPED structure.
+    overlapped.get()->Offset = static_cast<DWORD>(m_Offset);
+    overlapped.get()->OffsetHigh = static_cast<DWORD>(m_Offset >> 32);
+
+    BOOL ok = TransmitFile(socket.native_handle(), m_File, bytesToSend, 0, overlapped.get(), nullptr, 0);
+    DWORD lastError = GetLastError();
+
+    if (!ok && lastError != ERROR_IO_PENDING)
+        overlapped.complete(boost::system::error_code(lastError, boost::asio::error::get_system_category()), 0);
+    else
+        overlapped.release();
+}
+
+#else
+
+// private
+void FileTransfer::SendNext(boost::asio::ip::tcp::socket& socket)
+{
+    if (m_Remaining == 0)
+    {
+        Finish(socket, boost::system::error_code());
+        return;
+    }
+
+    std::size_t bytesToRead = static_cast<std::size_t>(std::min<uint64_t>(m_Remaining, m_ChunkBuffer.size()));
+    ssize_t bytesRead;
+    do
+    {
+        bytesRead = pread(m_File, m_ChunkBuffer.data(), bytesToRead, static_cast<off_t>(m_Offset));
+    }
+    while (bytesRead < 0 && errno == EINTR);
+
+    if (bytesRead <= 0)
+    {
+        Finish(socket, bytesRead == 0 ? boost::system::error_code(boost::asio::error::eof)
+            : boost::system::error_code(errno, boost::asio::error::get_system_category()));
+        return;
+    }
+
+    boost::asio::async_write(socket, boost::asio::buffer(m_ChunkBuffer.data(), static_cast<std::size_t>(bytesRead)),
+        BindRecyclingAllocator([self = shared_from_this(), &socket](const boost::system::error_code& ec, std::size_t bytesSent)
+        {
+            if (ec)
+            {
+                self->Finish(socket, ec);
+                return;
+            }
+
+            self->Advance(bytesSent);
+            self->SendNext(socket);
+        }));
+}
+
+#endif
+
+// private
+void FileTransfer::Advance(std::size_t bytesSent)
+{
+    m_Offset += bytesSent;
+    m_Remaining -= bytesSent;
+    m_BytesSent += bytesSent;
+}
+
+// private
+void FileTransfer::Finish(boost::asio::ip::tcp::socket& socket, const boost::system::error_code& ec)
+{
+    Complete(ec);
+
+    // posted, so that a file that is sent right away does not start the next one of its client from within AsyncSend().
+    boost::asio::post(socket.get_executor(),
+        BindRecyclingAllocator([self = shared_from_this(), ec]()
+        {
+            SendHandler handler = std::move(self->m_SendHandler);
+            self->m_SendHandler = nullptr;
+
+            if (handler)
+                handler(ec);
+        }));
+}
+
+// private static
+int64_t FileTransfer::GetFileSize(NativeHandle file)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+        return -1;
+
+    return size.QuadPart;
+#else
+    struct stat status;
+    if (fstat(file, &status) != 0)
+        return -1;
+
+    return status.st_size;
+#endif
+}
+
+// private static
+void FileTransfer::CloseFile(NativeHandle file)
+{
+#if defined(_WIN32)
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+}
+
+END_NAMESPACE_TCP
@@ -0,0 +1,381 @@
+#include "FrameAssembler.h"
+
+BEGIN_NAMESPACE_TCP
+
+// public
+FrameAssembler::FrameAssembler(const FramingOptions& options, OnFrameCallback onFrame, FrameStreamCallbacks streamCallbacks)
+    : m_Options(ValidateOptions(options))
+    , m_OnFrame(std::move(onFrame))
+    , m_StreamCallbacks(std::move(streamCallbacks))
+    , m_DelimiterScanner(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(m_Options.Delimiter.data()), m_Options.Delimiter.size()))
+    , m_PartialFrameSize(0)
+    , m_PartialPrefixSize(0)
+    , m_ParseScanOffset(0)
+    , m_StreamRemaining(0)
+{
+}
+
+// public
+bool FrameAssembler::Feed(std::span<const uint8_t> data)
+{
+    if (m_Options.Mode == FramingMode::Delimited)
+        return FeedDelimited(data);
+
+    return FeedLengthPrefixed(data);
+}
+
+// public
+std::ptrdiff_t FrameAssembler::Parse(std::span<const uint8_t> data)
+{
+    if (m_Options.Mode == FramingMode::Delimited)
+        return ParseDelimited(data);
+
+    return ParseLengthPrefixed(data);
+}
+
+// public
+bool FrameAssembler::FeedRing(MirroredRingBuffer& ring)
+{
+    for (;;)
+    {
+        // only the bytes that finish a streamed or an oversized frame go through the assembler.
+        if (HasPartialFrame())
+        {
+            std::ptrdiff_t consumed = FinishPartialFrame(ring.GetReadSpan());
+            if (consumed < 0)
+                return false;
+
+            ring.Consume(static_cast<std::size_t>(consumed));
+            if (HasPartialFrame())
+                return true;
+        }
+
+        // the start of a split frame stays in the ring buffer, and is parsed again in place after the next read.
+        std::ptrdiff_t consumed = Parse(ring.GetReadSpan());
+        if (consumed < 0)
+            return false;
+
+        ring.Consume(static_cast<std::size_t>(consumed));
+
+        // a message started streaming, its bytes follow its prefix.
+        if (!HasPartialFrame())
+            break;
+    }
+
+    // the ring buffer is full with the start of a frame that does not fit into it, it is reassembled by the assembler.
+    if (ring.FreeSpace() == 0)
+    {
+        m_ParseScanOffset = 0;
+        bool isValid = Feed(ring.GetReadSpan());
+        ring.Clear();
+        return isValid;
+    }
+
+    return true;
+}
+
+// private
+std::ptrdiff_t FrameAssembler::FinishPartialFrame(std::span<const uint8_t> data)
+{
+    std::size_t consumed = 0;
+
+    while (HasPartialFrame() && consumed < data.size())
+    {
+        std::span<const uint8_t> rest = data.subspan(consumed);
+
+        std::ptrdiff_t result = 0;
+        if (m_StreamRemaining)
+            result = FeedStream(rest);
+        else if (m_Options.Mode == FramingMode::Delimited)
+            result = FeedPartialLine(rest);
+        else
+            result = FeedPartialFrame(rest);
+
+        if (result < 0)
+            return -1;
+
+        consumed += static_cast<std::size_t>(result);
+    }
+
+    return static_cast<std::ptrdiff_t>(consumed);
+}
+
+// private
+bool FrameAssembler::FeedLengthPrefixed(std::span<const uint8_t> data)
+{
+    while (!data.empty())
+    {
+        std::ptrdiff_t consumed = 0;
+
+        if (m_StreamRemaining)
+        {
+            // continue the message that is being streamed.
+            consumed = FeedStream(data);
+        }
+        else if (!m_Buffer.empty())
+        {
+            // complete the frame that was split across the previous chunks.
+            consumed = FeedPartialFrame(data);
+        }
+        else
+        {
+            // deliver the frames that are complete inside this chunk, straight from the chunk.
+            consumed = ParseLengthPrefixed(data);
+
+            // the rest of the chunk is the start of a frame, keep it till the rest of the frame arrives.
+            if (consumed == 0 && !m_StreamRemaining)
+                consumed = FeedPartialFrame(data);
+        }
+
+        if (consumed < 0)
+            return false;
+
+        data = data.subspan(static_cast<std::size_t>(consumed));
+    }
+
+    return true;
+}
+
+// private
+std::ptrdiff_t FrameAssembler::FeedStream(std::span<const uint8_t> data)
+{
+    std::size_t chunkSize = static_cast<std::size_t>(std::min<uint64_t>(m_StreamRemaining, data.size()));
+    m_StreamRemaining -= chunkSize;
+
+    m_StreamCallbacks.OnChunk(data.subspan(0, chunkSize));
+    if (m_StreamRemaining == 0)
+        m_StreamCallbacks.OnEnd();
+
+    return static_cast<std::ptrdiff_t>(chunkSize);
+}
+
+// private
+void FrameAssembler::BeginStream(uint64_t length)
+{
+    m_StreamRemaining = length;
+    m_StreamCallbacks.OnBegin(length);
+}
+
+// private
+std::ptrdiff_t FrameAssembler::ParseLengthPrefixed(std::span<const uint8_t> data)
+{
+    std::size_t consumed = 0;
+
+    while (consumed < data.size())
+    {
+        std::span<const uint8_t> rest = data.subspan(consumed);
+
+        uint64_t length = 0;
+        std::size_t prefixSize = 0;
+        FramePrefixStatus status = DecodeFramePrefix(m_Options.Prefix, rest.data(), rest.size(), m_Options.MaxFrameSize, length, prefixSize);
+
+        if (status == FramePrefixStatus::Invalid)
+            return -1;
+
+        if (status == FramePrefixStatus::Incomplete)
+            break;
+
+        // a large message is streamed from here on, its bytes are never buffered.
+        if (IsStreamedFrameLength(length))
+        {
+            BeginStream(length);
+            consumed += prefixSize;
+            break;
+        }
+
+        if (rest.size() - prefixSize < length)
+            break;
+
+        m_OnFrame(rest.subspan(prefixSize, static_cast<std::size_t>(length)));
+        consumed += prefixSize + static_cast<std::size_t>(length);
+    }
+
+    return static_cast<std::ptrdiff_t>(consumed);
+}
+
+// private
+bool FrameAssembler::FeedDelimited(std::span<const uint8_t> data)
+{
+    // first complete the line that was split across the previous chunks.
+    if (!m_Buffer.empty())
+    {
+        std::ptrdiff_t consumed = FeedPartialLine(data);
+        if (consumed < 0)
+            return false;
+
+        data = data.subspan(static_cast<std::size_t>(consumed));
+        if (!m_Buffer.empty())
+            return true;
+    }
+
+    // deliver the lines that are complete inside this chunk, straight from the chunk.
+    std::ptrdiff_t consumed = ParseDelimited(data);
+    m_ParseScanOffset = 0;
+    if (consumed < 0)
+        return false;
+
+    // keep the start of the line till the rest of it arrives.
+    data = data.subspan(static_cast<std::size_t>(consumed));
+    m_Buffer.assign(data.begin(), data.end());
+    return true;
+}
+
+// private
+std::ptrdiff_t FrameAssembler::FeedPartialLine(std::span<const uint8_t> data)
+{
+    const std::size_t delimiterSize = m_Options.Delimiter.size();
+
+    std::size_t straddle = FindStraddlingDelimiter(data);
+    std::size_t end = straddle ? 0 : m_DelimiterScanner.Find(data);
+
+    if (!straddle && end == DelimiterScanner::npos)
+    {
+        if (m_Buffer.size() + data.size() > m_Options.MaxFrameSize + delimiterSize)
+            return -1;
+
+        m_Buffer.insert(m_Buffer.end(), data.begin(), data.end());
+        return static_cast<std::ptrdiff_t>(data.size());
+    }
+
+    std::size_t lineSize = straddle ? m_Buffer.size() - straddle : m_Buffer.size() + end;
+    if (lineSize > m_Options.MaxFrameSize)
+        return -1;
+
+    m_Buffer.insert(m_Buffer.end(), data.begin(), data.begin() + (straddle ? 0 : end));
+    m_OnFrame(std::span<const uint8_t>(m_Buffer.data(), lineSize));
+
+    if (m_Buffer.capacity() > RetainedBufferCapacity)
+        std::vector<uint8_t>().swap(m_Buffer);
+    else
+        m_Buffer.clear();
+
+    return static_cast<std::ptrdiff_t>(straddle ? delimiterSize - straddle : end + delimiterSize);
+}
+
+// private
+std::ptrdiff_t FrameAssembler::ParseDelimited(std::span<const uint8_t> data)
+{
+    const std::size_t delimiterSize = m_Options.Delimiter.size();
+    std::size_t consumed = 0;
+
+    while (consumed < data.size())
+    {
+        std::span<const uint8_t> rest = data.subspan(consumed);
+
+        // the unconsumed bytes of the previous call were already scanned, only the new bytes need to be.
+        std::size_t scanOffset = std::min(m_ParseScanOffset, rest.size());
+        std::size_t end = m_DelimiterScanner.Find(rest.subspan(scanOffset));
+        m_ParseScanOffset = 0;
+
+        if (end == DelimiterScanner::npos)
+        {
+            if (rest.size() > m_Options.MaxFrameSize + delimiterSize)
+                return -1;
+
+            // the last bytes may be the start of a delimiter that is completed by the next chunk.
+            m_ParseScanOffset = rest.size() - std::min(rest.size(), delimiterSize - 1);
+            break;
+        }
+
+        end += scanOffset;
+        if (end > m_Options.MaxFrameSize)
+            return -1;
+
+        m_OnFrame(rest.subspan(0, end));
+        consumed += end + delimiterSize;
+    }
+
+    return static_cast<std::ptrdiff_t>(consumed);
+}
+
+// private static
+FramingOptions FrameAssembler::ValidateOptions(const FramingOptions& options)
+{
+    FramingOptions validOptions = options;
+    if (validOptions.Delimiter.empty())
+    {
+        printf("\nFramingOptions::Delimiter must not be empty, using CRLF.");
+        validOptions.Delimiter = CRLF;
+    }
+
+    return validOptions;
+}
+
+// private
+std::size_t FrameAssembler::FindStraddlingDelimiter(std::span<const uint8_t> data) const
+{
+    const std::string& delimiter = m_Options.Delimiter;
+
+    // 'k' bytes of the delimiter at the end of the buffer, and the remaining bytes at the start of the data.
+    for (std::size_t k = std::min(delimiter.size() - 1, m_Buffer.size()); k > 0; --k)
+    {
+        if (data.size() < delimiter.size() - k)
+            continue;
+
+        if (std::memcmp(m_Buffer.data() + m_Buffer.size() - k, delimiter.data(), k) == 0
+            && std::memcmp(data.data(), delimiter.data() + k, delimiter.size() - k) == 0)
+        {
+            return k;
+        }
+    }
+
+    return 0;
+}
+
+// private
+std::ptrdiff_t FrameAssembler::FeedPartialFrame(std::span<const uint8_t> data)
+{
+    std::size_t consumed = 0;
+
+    // the prefix is appended byte by byte, so that no byte after the prefix is consumed before the frame size is known.
+    while (m_PartialFrameSize == 0 && consumed < data.size())
+    {
+        m_Buffer.push_back(data[consumed++]);
+
+        uint64_t length = 0;
+        std::size_t prefixSize = 0;
+        FramePrefixStatus status = DecodeFramePrefix(m_Options.Prefix, m_Buffer.data(), m_Buffer.size(), m_Options.MaxFrameSize, length, prefixSize);
+
+        if (status == FramePrefixStatus::Invalid)
+            return -1;
+
+        if (status == FramePrefixStatus::Complete)
+        {
+            if (IsStreamedFrameLength(length))
+            {
+                m_Buffer.clear();
+                BeginStream(length);
+                return static_cast<std::ptrdiff_t>(consumed);
+            }
+
+            m_PartialPrefixSize = prefixSize;
+            m_PartialFrameSize = prefixSize + static_cast<std::size_t>(length);
+            m_Buffer.reserve(m_PartialFrameSize);
+        }
+    }
+
+    if (m_PartialFrameSize == 0)
+        return static_cast<std::ptrdiff_t>(consumed);
+
+    std::size_t bytesToCopy = std::min(m_PartialFrameSize - m_Buffer.size(), data.size() - consumed);
+    m_Buffer.insert(m_Buffer.end(), data.begin() + consumed, data.begin() + consumed + bytesToCopy);
+    consumed += bytesToCopy;
+
+    if (m_Buffer.size() == m_PartialFrameSize)
+    {
+        m_OnFrame(std::span<const uint8_t>(m_Buffer).subspan(m_PartialPrefixSize));
+
+        // don't keep a large reassembly buffer around after a large frame.
+        if (m_Buffer.capacity() > RetainedBufferCapacity)
+            std::vector<uint8_t>().swap(m_Buffer);
+        else
+            m_Buffer.clear();
+
+        m_PartialFrameSize = 0;
+        m_PartialPrefixSize = 0;
+    }
+
+    return static_cast<std::ptrdiff_t>(consumed);
+}
+
+END_NAMESPACE_TCP
@@ -0,0 +1,271 @@
+#include "OutboundQueue.h"
+
+BEGIN_NAMESPACE_TCP
+
+// public
+OutboundQueue::OutboundQueue(std::size_t bulkBatchMaxBytes)
+    : m_BulkBatchMaxBytes(bulkBatchMaxBytes)
+{
+}
+
+// public
+void OutboundQueue::Push(const SharedPayload& message, MessagePriority priority)
+{
+    if (message.IsEmpty())
+        return;
+
+    m_QueuedBytes += message.Size();
+
+    if (priority == MessagePriority::Control)
+        m_Control.push_back(message);
+    else
+        m_Pending.push_back(message);
+}
+
+// public
+SharedPayload OutboundQueue::PushConflated(const SharedPayload& message, ConflationKey key)
+{
+    if (message.IsEmpty())
+        return SharedPayload();
+
+    std::ptrdiff_t index = FindConflated(key);
+    if (index >= 0)
+    {
+        // replaced in place, so the message keeps the position of the first update of its key.
+        SharedPayload replaced = std::move(GetPending(index));
+        GetPending(index) = message;
+        m_QueuedBytes = m_QueuedBytes - replaced.Size() + message.Size();
+        return replaced;
+    }
+
+    uint64_t sequence = m_PendingBase + GetNumPending();
+    m_ConflatedMessages[key] = sequence;
+    m_ConflatedOrder.emplace_back(sequence, key);
+
+    Push(message, MessagePriority::Bulk);
+    return SharedPayload();
+}
+
+// public
+std::size_t OutboundQueue::GetConflatedSize(ConflationKey key) const
+{
+    std::ptrdiff_t index = FindConflated(key);
+    return index >= 0 ? GetPending(index).Size() : 0;
+}
+
+// public
+void OutboundQueue::PushFile(FileTransferSPtr file)
+{
+    if (file)
+        m_Files.push_back({ GetNumPending(), std::move(file) });
+}
+
+// public
+FileTransferSPtr OutboundQueue::PopFile()
+{
+    FileTransferSPtr file = std::move(m_Files.front().File);
+    m_Files.pop_front();
+    return file;
+}
+
+// public
+std::vector<FileTransferSPtr> OutboundQueue::TakeFiles()
+{
+    std::vector<FileTransferSPtr> files;
+    files.reserve(m_Files.size());
+
+    for (QueuedFile& file : m_Files)
+        files.push_back(std::move(file.File));
+
+    m_Files.clear();
+    return files;
+}
+
+// public
+std::span<const boost::asio::const_buffer> OutboundQueue::PrepareBatch()
+{
+    m_InFlightBuffers.clear();
+
+    // only the bulk messages before the next file go into the batch.
+    std::size_t numPending = GetNumPending();
+    std::size_t numMessages = m_Files.empty() ? numPending : m_Files.front().Position;
+
+    if (m_BulkBatchMaxBytes)
+    {
+        // at least one message is taken, so a message larger than the limit is still written.
+        std::size_t numBytes = 0;
+        std::size_t numTaken = 0;
+        while (numTaken < numMessages && (numTaken == 0 || numBytes + GetPending(numTaken).Size() <= m_BulkBatchMaxBytes))
+            numBytes += GetPending(numTaken++).Size();
+
+        numMessages = numTaken;
+    }
+
+    if (m_Control.empty() && m_PendingHead == 0 && numMessages == numPending)
+    {
+        // the in-flight batch is empty here, swapping reuses the memory of both vectors for the next batches.
+        m_InFlight.swap(m_Pending);
+    }
+    else
+    {
+        // the control messages go first, m_Control gets the memory of the empty in-flight batch.
+        m_InFlight.swap(m_Control);
+        auto first = m_Pending.begin() + m_PendingHead;
+        m_InFlight.insert(m_InFlight.end(), std::make_move_iterator(first), std::make_move_iterator(first + numMessages));
+        PopPendingFront(numMessages);
+    }
+
+    for (QueuedFile& file : m_Files)
+        file.Position -= numMessages;
+
+    OnPendingRemoved(numMessages);
+
+    m_InFlightBytes = 0;
+    for (const SharedPayload& message : m_InFlight)
+    {
+        m_InFlightBuffers.push_back(boost::asio::buffer(message.Data(), message.Size()));
+        m_InFlightBytes += message.Size();
+    }
+
+    m_QueuedBytes -= m_InFlightBytes;
+
+    return m_InFlightBuffers;
+}
+
+// public
+void OutboundQueue::CompleteBatch()
+{
+    m_InFlight.clear();
+    m_InFlightBuffers.clear();
+    m_InFlightBytes = 0;
+}
+
+// public
+std::vector<SharedPayload> OutboundQueue::TakeBatch(std::vector<SharedPayload>&& spare)
+{
+    std::vector<SharedPayload> messages = std::move(spare);
+    messages.clear();
+    m_InFlight.swap(messages);
+    CompleteBatch();
+    return messages;
+}
+
+// public
+std::size_t OutboundQueue::DropOldest(std::size_t bytesToFree, std::optional<ConflationKey> keep)
+{
+    std::ptrdiff_t keepIndex = keep ? FindConflated(*keep) : -1;
+
+    std::size_t end = 0;
+    std::size_t bytesFreed = 0;
+
+    while (end < GetNumPending() && bytesFreed < bytesToFree)
+    {
+        if (static_cast<std::ptrdiff_t>(end) != keepIndex)
+            bytesFreed += GetPending(end).Size();
+        ++end;
+    }
+
+    // the kept message takes the place of the last dropped one, right before the remaining messages.
+    bool isKept = keepIndex >= 0 && static_cast<std::size_t>(keepIndex) < end;
+    bool isKeptMoved = isKept && static_cast<std::size_t>(keepIndex) != end - 1;
+    if (isKeptMoved)
+        std::swap(GetPending(keepIndex), GetPending(end - 1));
+
+    std::size_t numDropped = isKept ? end - 1 : end;
+
+    // only the head index moves, so a consumer that is stuck does not pay for its whole queue on every message.
+    PopPendingFront(numDropped);
+    m_QueuedBytes -= bytesFreed;
+
+    for (QueuedFile& file : m_Files)
+    {
+        std::size_t position = file.Position - std::min(file.Position, numDropped);
+
+        // a file that was queued after the kept message is still written after it.
+        if (isKept && file.Position > static_cast<std::size_t>(keepIndex))
+            position = std::max<std::size_t>(position, 1);
+
+        file.Position = position;
+    }
+
+    OnPendingRemoved(numDropped);
+
+    // the kept message is now the first one, in the place of a dropped message whose key must not find it anymore.
+    if (isKeptMoved)
+    {
+        ForgetConflatedBefore(m_PendingBase + 1);
+        m_ConflatedMessages[*keep] = m_PendingBase;
+        m_ConflatedOrder.emplace_front(m_PendingBase, *keep);
+    }
+
+    return numDropped;
+}
+
+// public
+void OutboundQueue::ClearMessages()
+{
+    m_Control.clear();
+
+    std::size_t numPending = GetNumPending();
+    PopPendingFront(numPending);
+    OnPendingRemoved(numPending);
+
+    for (QueuedFile& file : m_Files)
+        file.Position = 0;
+
+    m_QueuedBytes = 0;
+}
+
+// private
+void OutboundQueue::PopPendingFront(std::size_t numMessages)
+{
+    // the messages that were moved into the batch are empty already, the dropped ones are released here.
+    for (std::size_t i = 0; i < numMessages; ++i)
+        GetPending(i) = SharedPayload();
+
+    m_PendingHead += numMessages;
+
+    if (m_PendingHead == m_Pending.size())
+    {
+        m_Pending.clear();
+        m_PendingHead = 0;
+    }
+    else if (m_PendingHead > m_Pending.size() / 2)
+    {
+        // fewer messages are moved than slots are erased, so the erases cost O(1) per message taken off the front.
+        m_Pending.erase(m_Pending.begin(), m_Pending.begin() + m_PendingHead);
+        m_PendingHead = 0;
+    }
+}
+
+// private
+void OutboundQueue::OnPendingRemoved(std::size_t numMessages)
+{
+    m_PendingBase += numMessages;
+    ForgetConflatedBefore(m_PendingBase);
+}
+
+// private
+void OutboundQueue::ForgetConflatedBefore(uint64_t sequence)
+{
+    while (!m_ConflatedOrder.empty() && m_ConflatedOrder.front().first < sequence)
+    {
+        auto it = m_ConflatedMessages.find(m_ConflatedOrder.front().second);
+        if (it != m_ConflatedMessages.end() && it->second == m_ConflatedOrder.front().first)
+            m_ConflatedMessages.erase(it);
+
+        m_ConflatedOrder.pop_front();
+    }
+}
+
+// private
+std::ptrdiff_t OutboundQueue::FindConflated(ConflationKey key) const
+{
+    auto it = m_ConflatedMessages.find(key);
+    if (it == m_ConflatedMessages.end() || it->second < m_PendingBase)
+        return -1;
+
+    return static_cast<std::ptrdiff_t>(it->second - m_PendingBase);
+}
+
+END_NAMESPACE_TCP
@@ -0,0 +1,40 @@
+#include "ReadBufferPool.h"
+
+BEGIN_NAMESPACE_TCP
+
+// public static
+ReadBufferPool& ReadBufferPool::ForThisThread()
+{
+    thread_local ReadBufferPool pool;
+    return pool;
+}
+
+// public
+std::vector<uint8_t> ReadBufferPool::Acquire(std::size_t size)
+{
+    while (!m_FreeBuffers.empty())
+    {
+        std::vector<uint8_t> buffer = std::move(m_FreeBuffers.back());
+        m_FreeBuffers.pop_back();
+
+        if (buffer.size() >= size)
+            return buffer;
+    }
+
+    return std::vector<uint8_t>(size);
+}
+
+// public
+void ReadBufferPool::Release(std::vector<uint8_t>&& buffer)
+{
+    if (buffer.empty() || m_FreeBuffers.size() >= MaxFreeBuffers)
+    {
+        buffer = std::vector<uint8_t>();
+        return;
+    }
+
+    m_FreeBuffers.push_back(std::move(buffer));
+    buffer = std::vector<uint8_t>();
+}
+
+END_NAMESPACE_TCP
@@ -1,25 +1,86 @@
 #include "Server.h"
 #include "ClientHandler.h"
 #include "TCPCommon/IOBuffer.h"
+#include "TCPCommon/HandlerAllocator.h"
 #include <iostream>
 #include <vector>
 #include <array>
 #include <algorithm>
 #include <boost/asio.hpp>
-#include <boost/bind/bind.hpp>
 
 using boost::asio::ip::tcp;
 
 BEGIN_NAMESPACE_TCP
 
+/**
+* Returns the config of Server(port, maxClientsAllowed), all the other settings keep their defaults.
+*/
+static ServerConfig MakeDefaultConfig(int port, uint32_t maxClientsAllowed)
+{
+    ServerConfig config;
+    config.Port = port;
+    config.MaxClientsAllowed = maxClientsAllowed;
+    return config;
+}
+
+/**
+* Returns the number of shards of a server with the given config, the shard index is stored in the upper 8 bits of a ClientID.
+*/
+static uint32_t ClampNumShards(const ServerConfig& config)
+{
+    return std::clamp<uint32_t>(config.NumShards, 1, 1u << (sizeof(ClientID) * 8 - ClientRegistry::ShardShift));
+}
+
 // public
 Server::Server(int port, uint32_t maxClientsAllowed)
-    : m_MaxClientsAllowed(maxClientsAllowed)
-    , m_Port(port)
-    , m_IOContext()
-    , m_Acceptor(IOContext(), boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
-    , m_NewClientID(1)
+    : Server(MakeDefaultConfig(port, maxClientsAllowed))
+{
+}
+
+// public
+Server::Server(const ServerConfig& config)
+    : m_Config(config)
+    , m_Port(config.Port)
+    , m_NumThreads(std::max<uint32_t>(config.NumThreads, 1))
+    , m_Stats(ClampNumShards(config))
+    , m_NextShardIndex(0)
+    , m_NumClients(0)
+    , m_ShardsAcceptOwnClients(false)
+    , m_MaxClientsAllowed(config.MaxClientsAllowed)
 {
+    m_ClientCallbacks.OnDataReceived = [this](ClientHandler& client, std::span<const uint8_t> data) { OnDataReceived(client, data); };
+    m_ClientCallbacks.OnDataReceivedError = [this](ClientID ID, const boost::system::error_code& ec) { OnDataReceivedError(ID, ec); };
+    m_ClientCallbacks.OnClientDisconnected = [this](ClientID ID) { OnClientDisconnected(ID); };
+    m_ClientCallbacks.OnMessage = [this](ClientID ID, std::span<const uint8_t> message) { OnMessage(ID, message); };
+    m_ClientCallbacks.OnMessageBegin = [this](ClientID ID, uint64_t size) { OnMessageBegin(ID, size); };
+    m_ClientCallbacks.OnMessageChunk = [this](ClientID ID, std::span<const uint8_t> chunk) { OnMessageChunk(ID, chunk); };
+    m_ClientCallbacks.OnMessageEnd = [this](ClientID ID) { OnMessageEnd(ID); };
+    m_ClientCallbacks.OnProtocolDetected = [this](ClientID ID, std::size_t protocolIndex) { return OnProtocolDetected(ID, protocolIndex); };
+    m_ClientCallbacks.OnClientBackpressure = [this](ClientID ID, std::size_t queuedBytes) { OnClientBackpressure(ID, queuedBytes); };
+    m_ClientCallbacks.OnOutboundHighWatermark = [this](ClientID ID, std::size_t queuedBytes) { OnOutboundHighWatermark(ID, queuedBytes); };
+    m_ClientCallbacks.OnOutboundLowWatermark = [this](ClientID ID, std::size_t queuedBytes) { OnOutboundLowWatermark(ID, queuedBytes); };
+
+    uint32_t numShards = ClampNumShards(config);
+    for (uint32_t i = 0; i < numShards; ++i)
+        m_Shards.push_back(std::make_unique<ServerShard>(i, m_NumThreads));
+
+#if defined(SO_REUSEPORT)
+    // every shard listens on the port itself, the kernel balances the connections between them.
+    bool reusePort = numShards > 1;
+#else
+    bool reusePort = false;
+#endif
+
+    m_ShardsAcceptOwnClients = reusePort;
+    if (reusePort)
+    {
+        for (auto& shard : m_Shards)
+            shard->OpenAcceptor(config.Port, true, config.ListenBacklog, config.ClientSocketOptions);
+    }
+    else
+    {
+        m_Shards.front()->OpenAcceptor(config.Port, false, config.ListenBacklog, config.ClientSocketOptions);
+    }
 }
 
 // public
@@ -31,13 +92,16 @@ Server::~Server()
 // public
 bool Server::Start()
 {
-    printf("\nStarting Server on port : %d", GetPort());
-    // order is important, as the context needs some work to do, else it will end the context thread.
-    WaitToAcceptNewConnection();
-    m_ContextThread = std::thread([this]()
-        {
-            IOContext().run(); 
-        });
+    printf("\nStarting Server on port : %d, with %u shard(s) of %u thread(s)", GetPort(), GetNumShards(), GetNumThreads());
+    // order is important, as the context needs some work to do, else it will end the context threads.
+    for (auto& shard : m_Shards)
+    {
+        if (shard->GetAcceptor())
+            WaitToAcceptNewConnection(*shard);
+    }
+
+    for (auto& shard : m_Shards)
+        shard->Start();
 
     return false;
 }
@@ -45,14 +109,23 @@ bool Server::Start()
 // public
 bool Server::Stop()
 {
-    if(m_ContextThread.joinable())
-        m_ContextThread.join();
+    for (auto& shard : m_Shards)
+        shard->Stop();
 
-    IOContext().stop();
+    for (auto& shard : m_Shards)
+        shard->Join();
 
     return false;
 }
 
+// public virtual
+void Server::OnDataReceived(ClientHandler& client, std::span<const uint8_t> data)
+{
+    /* fall back to the ID based callback, that reads the data through GetClient(ID)->GetReadBuffer() */
+    (void)data;
+    OnDataReceived(client.GetID());
+}
+
 // public
 void Server::OnDataReceivedError(
     ClientID clientID, 
@@ -65,60 +138,58 @@ void Server::OnDataReceivedError(
 // public
 void Server::OnClientDisconnected(ClientID clientID)
 {
-    auto clientHandle = m_ClientHandlers[clientID];
-    const auto& clientInfo = clientHandle->GetInfoString();
-
-    uint32_t id = clientHandle->GetID();
-    auto iter = m_ClientHandlers.find(id);
-    if (iter == m_ClientHandlers.end())
+    ServerShard* shard = GetShard(clientID);
+    if (!shard)
         return;
-     
-    // remove the client from our clients map
-    std::lock_guard guard(m_MutexClients);
-    iter->second.reset();
-    m_ClientHandlers.erase(id);
+
+    // remove the client from its shard
+    if (shard->RemoveClient(clientID))
+        --m_NumClients;
 }
 
 // public virtual
 bool Server::OnClientConnected(boost::asio::ip::tcp::socket socket)
 {
-    // check if max client limit is reached
-    if (m_ClientHandlers.size() >= m_MaxClientsAllowed)
+    return AddClient(NextShard(), std::move(socket));
+}
+
+// private
+bool Server::AddClient(ServerShard& shard, boost::asio::ip::tcp::socket socket)
+{
+    // check if max client limit is reached, the slot is reserved right away, as the shards may accept clients in parallel.
+    if (m_NumClients.fetch_add(1) >= m_MaxClientsAllowed)
     {
+        --m_NumClients;
         printf("\nMax Clients Allowed Limit Reached!");
         std::string message = "The Server has reached the Maximum number of allowed Clients Limit!\nYou will be disconnected!";
         Write(socket, message);
         return false;
     }
 
-    // first level of checking is done, so we can create a client handler object.
-    ClientHandlerSPtr newClientHandle = ClientHandler::Create(
-        std::move(socket), 
-        m_NewClientID, 
-        boost::bind(&Server::OnDataReceived, this, std::placeholders::_1),
-        boost::bind(&Server::OnDataReceivedError, this, std::placeholders::_1, std::placeholders::_2),
-        boost::bind(&Server::OnClientDisconnected, this, std::placeholders::_1));
+    for (const SocketOptionError& error : ApplySocketOptions(socket, m_Config.ClientSocketOptions))
+        printf("\nCould not set the socket option %s of a new client : %s", error.Name, error.Error.message().c_str());
 
-    // add the new client to the clients map.
-    m_MutexClients.lock();
-    m_ClientHandlers.insert(std::make_pair(m_NewClientID, newClientHandle));
-    m_MutexClients.unlock();
+    // first level of checking is done, so we can create a client handler object and add it to the shard.
+    ClientHandlerSPtr newClientHandle;
+    ClientID newClientID = shard.AddClient([&](ClientID ID)
+        {
+            newClientHandle = ClientHandler::Create(std::move(socket), ID, m_Config, m_ClientCallbacks, m_Stats);
+
+            return newClientHandle;
+        });
 
     // will call the derived classes func, for further checking.
-    if (!OnClientConnected(newClientHandle->GetID()))
+    if (!OnClientConnected(newClientID))
     {
-        // remove the new client from the clients map.
-        m_MutexClients.lock();
-        m_ClientHandlers.erase(m_NewClientID);
-        m_MutexClients.unlock();
+        // remove the new client from the shard.
+        if (shard.RemoveClient(newClientID))
+            --m_NumClients;
 
         printf("\n Connection refused to : %s", newClientHandle->GetInfoString().c_str());
         newClientHandle.reset();
         return false;
     }
 
-    ++m_NewClientID;
-
     // start an async task for reading data from the newClient
     newClientHandle->ScheduleRead();
 
@@ -126,12 +197,18 @@ bool Server::OnClientConnected(boost::asio::ip::tcp::socket socket)
 }
 
 //private
-void Server::WaitToAcceptNewConnection()
+void Server::WaitToAcceptNewConnection(ServerShard& shard)
 {
     try
     {
+        // with SO_REUSEPORT every shard accepts its own clients, else the connections are handed out round-robin.
+        ServerShard& targetShard = m_ShardsAcceptOwnClients ? shard : NextShard();
+
         printf("\nWaiting for New Connection...");
-        m_Acceptor.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
+        // every client socket gets its own strand, so that the handlers of a client are serialized
+        // even when the io_context is run from multiple threads.
+        shard.GetAcceptor()->async_accept(boost::asio::make_strand(targetShard.IOContext()),
+            BindRecyclingAllocator([this, &shard, &targetShard](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
             {
                 if (ec)
                 {
@@ -139,11 +216,11 @@ void Server::WaitToAcceptNewConnection()
                     return;
                 }
 
-                OnClientConnected(std::move(socket));
+                AddClient(targetShard, std::move(socket));
 
                 // schedule the next task to accept new connection.
-                WaitToAcceptNewConnection();
-            });
+                WaitToAcceptNewConnection(shard);
+            }));
     }
     catch (std::exception& e) 
     {
@@ -151,6 +228,43 @@ void Server::WaitToAcceptNewConnection()
     }
 }
 
+// private
+void Server::BroadcastWrite(
+    const SharedPayload& payload, 
+    ClientID clientToIgnoreID, 
+    MessagePriority priority, 
+    std::optional<ConflationKey> key)
+{
+    // the snapshots are walked on the calling thread, so every client queues the broadcast before any message that
+    // the caller sends after it, as the writes are dispatched to the strands of the clients in the order of the calls.
+    for (auto& shard : m_Shards)
+    {
+        shard->ForEachClient([&](ClientID ID, ClientHandler& client)
+            {
+                if (IsValidClientID(clientToIgnoreID) && ID == clientToIgnoreID)
+                    return;
+
+                client.ScheduleBroadcastWrite(payload, priority, key);
+            });
+    }
+}
+
+// private
+ServerShard& Server::NextShard()
+{
+    return *m_Shards[m_NextShardIndex++ % GetNumShards()];
+}
+
+// private
+ServerShard* Server::GetShard(ClientID ID) const
+{
+    uint32_t index = ServerShard::GetShardIndex(ID);
+    if (index >= m_Shards.size())
+        return nullptr;
+
+    return m_Shards[index].get();
+}
+
 // public
 void Server::Write(
     boost::asio::ip::tcp::socket& socket, 
@@ -192,8 +306,9 @@ void Server::Write(
     const std::vector<uint8_t>& buffer, 
     std::size_t numBytesToWrite)
 {
-    ClientHandlerSPtr clientHandle = m_ClientHandlers[ID];
-    clientHandle->Write(buffer, numBytesToWrite);
+    ClientHandlerSPtr clientHandle = GetClient(ID);
+    if (clientHandle)
+        clientHandle->Write(buffer, numBytesToWrite);
 }
 
 // public
@@ -212,8 +327,88 @@ void Server::AsyncWrite(
     if (numBytesToWrite == 0)
         numBytesToWrite = buffer.size();
 
-    ClientHandlerSPtr client = m_ClientHandlers[ID];
-    client->ScheduleWrite(buffer, numBytesToWrite);
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ScheduleWrite(buffer, numBytesToWrite);
+}
+
+// public
+bool Server::SendFile(
+    ClientID ID, 
+    const std::string& path, 
+    uint64_t offset, 
+    uint64_t length, 
+    OnFileSentCallback onSent)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (!client)
+        return false;
+
+    FileTransferSPtr file = FileTransfer::Open(path, offset, length, std::move(onSent));
+    if (!file)
+        return false;
+
+    client->ScheduleSendFile(std::move(file));
+    return true;
+}
+
+// public
+bool Server::SendFile(
+    ClientID ID, 
+    FileTransfer::NativeHandle file, 
+    uint64_t offset, 
+    uint64_t length, 
+    OnFileSentCallback onSent)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (!client)
+        return false;
+
+    FileTransferSPtr transfer = FileTransfer::FromNativeHandle(file, offset, length, std::move(onSent));
+    if (!transfer)
+        return false;
+
+    client->ScheduleSendFile(std::move(transfer));
+    return true;
+}
+
+// public
+void Server::PauseReading(ClientID ID)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->PauseReading();
+}
+
+// public
+void Server::ResumeReading(ClientID ID)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ResumeReading();
+}
+
+// public
+void Server::ReportInboundQueued(ClientID ID, std::size_t bytes)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ReportInboundQueued(bytes);
+}
+
+// public
+void Server::ReportInboundConsumed(ClientID ID, std::size_t bytes)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ReportInboundConsumed(bytes);
+}
+
+// public
+ReceiveClock::time_point Server::GetLastReceiveTimestamp(ClientID ID)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    return client ? client->GetLastReceiveTimestamp() : ReceiveClock::time_point();
 }
 
 // public
@@ -240,8 +435,20 @@ void Server::MessageClient(
     const std::vector<uint8_t>& buffer, 
     std::size_t numBytesToWrite)
 {
-    ClientHandlerSPtr client = m_ClientHandlers[ID];
-    client->ScheduleWrite(buffer, numBytesToWrite);
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ScheduleWrite(buffer, numBytesToWrite);
+}
+
+// public
+void Server::MessageClient(
+    ClientID ID, 
+    const SharedPayload& payload, 
+    MessagePriority priority)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ScheduleWrite(payload, priority);
 }
 
 // public
@@ -249,14 +456,8 @@ void Server::MessageAllClients(
     const net::IOBuffer& buffer, 
     ClientID clientToIgnoreID)
 {
-    for (auto iter : m_ClientHandlers)
-    {
-        std::size_t ID = iter.first;
-        if (IsValidClientID(clientToIgnoreID) && ID == clientToIgnoreID)
-            continue;
-
-        MessageClient(ID, buffer);
-    }
+    if (buffer.HasData())
+        MessageAllClients(buffer.ToSharedPayload(), clientToIgnoreID);
 }
 
 // public
@@ -269,18 +470,47 @@ void Server::MessageAllClients(
 
 // public
 void Server::MessageAllClients(
-    const std::vector<uint8_t>& message, 
+    const std::vector<uint8_t>& buffer, 
     std::size_t numBytesToWrite, 
     ClientID clientToIgnoreID)
 {
-    for (auto iter : m_ClientHandlers)
-    {
-        std::size_t ID = iter.first;
-        if (IsValidClientID(clientToIgnoreID) && ID == clientToIgnoreID)
-            continue;
+    // the buffer is copied once, every client only references the payload.
+    MessageAllClients(SharedPayload::Copy(buffer.data(), numBytesToWrite), clientToIgnoreID);
+}
 
-        MessageClient(ID, message, numBytesToWrite);
-    }
+// public
+void Server::MessageAllClients(
+    const SharedPayload& payload, 
+    ClientID clientToIgnoreID, 
+    MessagePriority priority)
+{
+    if (payload.IsEmpty())
+        return;
+
+    BroadcastWrite(payload, clientToIgnoreID, priority, std::nullopt);
+}
+
+// public
+void Server::MessageClientConflated(
+    ClientID ID, 
+    ConflationKey key, 
+    const SharedPayload& payload)
+{
+    ClientHandlerSPtr client = GetClient(ID);
+    if (client)
+        client->ScheduleConflatedWrite(key, payload);
+}
+
+// public
+void Server::MessageAllClientsConflated(
+    ConflationKey key, 
+    const SharedPayload& payload, 
+    ClientID clientToIgnoreID)
+{
+    if (payload.IsEmpty())
+        return;
+
+    BroadcastWrite(payload, clientToIgnoreID, MessagePriority::Bulk, key);
 }
 
 // public
@@ -288,16 +518,25 @@ void Server::MessageAllClients(
     const std::string& message, 
     ClientID clientToIgnoreID)
 {
-    std::vector<uint8_t> buffer(message.begin(), message.end());
-    MessageAllClients(buffer, buffer.size(), clientToIgnoreID);
+    MessageAllClients(SharedPayload::Copy(reinterpret_cast<const uint8_t*>(message.data()), message.size()), clientToIgnoreID);
 }
 
 // public
 void Server::Wait()
 {
-    /* wait for the io_context to run out of jobs to perform */
-    if (m_ContextThread.joinable())
-        m_ContextThread.join();
+    /* wait for the io_context of every shard to run out of jobs to perform */
+    for (auto& shard : m_Shards)
+        shard->Join();
+}
+
+// protected
+const ClientHandlerSPtr Server::GetClient(ClientID ID) const
+{
+    ServerShard* shard = GetShard(ID);
+    if (!shard)
+        return nullptr;
+
+    return shard->GetClient(ID);
 }
 
 END_NAMESPACE_TCP
@@ -0,0 +1,236 @@
+#include "ServerShard.h"
+#include "ClientHandler.h"
+#include "TCPCommon/HandlerAllocator.h"
+
+BEGIN_NAMESPACE_TCP
+
+// public
+ServerShard::ServerShard(uint32_t index, uint32_t numThreads)
+    : m_Index(index)
+    , m_NumThreads(numThreads)
+    , m_IOContext(static_cast<int>(numThreads))
+    , m_ClientHandlers(index)
+    , m_Snapshot(nullptr)
+    , m_CurrentSnapshot(std::make_unique<const ClientSnapshot>())
+    , m_Epoch(0)
+    , m_NumReaders{ 0, 0 }
+    , m_NumRetired(0)
+{
+    m_Snapshot.store(m_CurrentSnapshot.get());
+}
+
+// public
+ServerShard::~ServerShard()
+{
+    Stop();
+    Join();
+}
+
+// public
+void ServerShard::OpenAcceptor(int port, bool reusePort, int backlog, const SocketOptions& socketOptions)
+{
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
+
+    m_Acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(IOContext());
+    m_Acceptor->open(endpoint.protocol());
+    m_Acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+
+#if defined(SO_REUSEPORT)
+    if (reusePort)
+        m_Acceptor->set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#else
+    (void)reusePort;
+#endif
+
+    // the window scale is negotiated during the handshake, before the socket is accepted.
+    SocketOptions listenerOptions;
+    listenerOptions.SendBufferSize = socketOptions.SendBufferSize;
+    listenerOptions.ReceiveBufferSize = socketOptions.ReceiveBufferSize;
+    for (const SocketOptionError& error : ApplySocketOptions(*m_Acceptor, listenerOptions))
+        printf("\nCould not set the socket option %s of the listener : %s", error.Name, error.Error.message().c_str());
+
+    m_Acceptor->bind(endpoint);
+    m_Acceptor->listen(backlog > 0 ? backlog : static_cast<int>(boost::asio::socket_base::max_listen_connections));
+}
+
+// public
+void ServerShard::Start()
+{
+    for (uint32_t i = 0; i < m_NumThreads; ++i)
+    {
+        m_ContextThreads.emplace_back([this]()
+            {
+                IOContext().run();
+            });
+    }
+}
+
+// public
+void ServerShard::Stop()
+{
+    IOContext().stop();
+}
+
+// public
+void ServerShard::Join()
+{
+    for (std::thread& contextThread : m_ContextThreads)
+    {
+        if (contextThread.joinable() && contextThread.get_id() != std::this_thread::get_id())
+            contextThread.join();
+    }
+}
+
+// public
+ClientID ServerShard::AddClient(const std::function<ClientHandlerSPtr(ClientID)>& createClient)
+{
+    std::lock_guard guard(m_MutexClients);
+
+    ClientID ID = m_ClientHandlers.Insert(createClient);
+    PublishSnapshot();
+
+    return ID;
+}
+
+// public
+bool ServerShard::RemoveClient(ClientID ID)
+{
+    std::lock_guard guard(m_MutexClients);
+    ClientHandlerSPtr removedClient = m_ClientHandlers.Remove(ID);
+    if (!removedClient)
+        return false;
+
+    // the readers that may still use the client keep it alive, till the shard reclaims it.
+    PublishSnapshot(std::move(removedClient));
+
+    return true;
+}
+
+// public
+ClientHandlerSPtr ServerShard::GetClient(ClientID ID) const
+{
+    EpochPin pin(*this);
+    const ClientSnapshot& snapshot = *m_Snapshot.load(std::memory_order_acquire);
+
+    uint32_t slotIndex = ClientRegistry::GetSlotIndex(ID);
+    if (slotIndex >= snapshot.ClientIndices.size())
+        return nullptr;
+
+    // the ID holds the shard and the generation of the slot, so an ID of another shard or a stale ID does not match.
+    uint32_t index = snapshot.ClientIndices[slotIndex];
+    if (index == ClientSnapshot::NoClient || snapshot.IDs[index] != ID)
+        return nullptr;
+
+    // the pin keeps the client alive, the registry or the retire list still owns it.
+    return snapshot.Clients[index]->shared_from_this();
+}
+
+// public
+void ServerShard::ForEachClient(const std::function<void(ClientID, ClientHandler&)>& func)
+{
+    {
+        EpochPin pin(*this);
+        const ClientSnapshot& snapshot = *m_Snapshot.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < snapshot.Clients.size(); ++i)
+            func(snapshot.IDs[i], *snapshot.Clients[i]);
+    }
+
+    TryReclaimRetired();
+}
+
+// public
+std::size_t ServerShard::GetNumClients() const
+{
+    std::lock_guard guard(m_MutexClients);
+    return m_ClientHandlers.Size();
+}
+
+// private
+void ServerShard::PublishSnapshot(ClientHandlerSPtr removedClient)
+{
+    auto snapshot = std::make_unique<ClientSnapshot>();
+    snapshot->IDs = m_ClientHandlers.GetIDs();
+
+    // plain pointers, copying the shared pointers would touch the reference count of every client on every change.
+    snapshot->Clients.reserve(m_ClientHandlers.Size());
+    for (const ClientHandlerSPtr& client : m_ClientHandlers.GetClients())
+        snapshot->Clients.push_back(client.get());
+
+    snapshot->ClientIndices.assign(m_ClientHandlers.GetNumSlots(), ClientSnapshot::NoClient);
+    for (std::size_t i = 0; i < snapshot->IDs.size(); ++i)
+        snapshot->ClientIndices[ClientRegistry::GetSlotIndex(snapshot->IDs[i])] = static_cast<uint32_t>(i);
+
+    m_Snapshot.store(snapshot.get());
+
+    // the readers that pinned the current epoch or an earlier one may still use the replaced snapshot and the removed client.
+    m_Retired.push_back(RetiredEntry{ m_Epoch.load(), std::move(m_CurrentSnapshot), std::move(removedClient) });
+    m_CurrentSnapshot = std::move(snapshot);
+
+    ReclaimRetired();
+}
+
+// private
+void ServerShard::ReclaimRetired()
+{
+    // a reader that pinned the epoch before the current one holds it back, so it moves on by two at most.
+    for (int step = 0; step < 2; ++step)
+    {
+        uint64_t epoch = m_Epoch.load();
+        if (m_NumReaders[(epoch + 1) & 1].load() != 0)
+            break;
+
+        m_Epoch.store(epoch + 1);
+    }
+
+    uint64_t epoch = m_Epoch.load();
+    while (!m_Retired.empty() && m_Retired.front().Epoch + 2 <= epoch)
+    {
+        RetiredEntry& entry = m_Retired.front();
+        if (entry.Client)
+        {
+            // the readers may have queued handlers that only hold a plain pointer of the client, the release goes behind them.
+            boost::asio::any_io_executor executor = entry.Client->GetExecutor();
+            boost::asio::post(executor, BindRecyclingAllocator([client = std::move(entry.Client)]() {}));
+        }
+
+        m_Retired.pop_front();
+    }
+
+    m_NumRetired.store(m_Retired.size(), std::memory_order_relaxed);
+}
+
+// private
+void ServerShard::TryReclaimRetired()
+{
+    if (m_NumRetired.load(std::memory_order_relaxed) == 0)
+        return;
+
+    // a walk does not wait for the mutex, the next walk or change of the clients reclaims the entries instead.
+    std::unique_lock guard(m_MutexClients, std::try_to_lock);
+    if (guard.owns_lock())
+        ReclaimRetired();
+}
+
+// private
+ServerShard::EpochPin::EpochPin(const ServerShard& shard)
+    : m_Shard(shard)
+{
+    // the pin only counts once the epoch is still the same after it, else the epoch may have moved on without seeing it.
+    for (;;)
+    {
+        m_Epoch = shard.m_Epoch.load();
+        shard.m_NumReaders[m_Epoch & 1].fetch_add(1);
+        if (shard.m_Epoch.load() == m_Epoch)
+            break;
+
+        shard.m_NumReaders[m_Epoch & 1].fetch_sub(1);
+    }
+}
+
+// private
+ServerShard::EpochPin::~EpochPin()
+{
+    m_Shard.m_NumReaders[m_Epoch & 1].fetch_sub(1);
+}
+
+END_NAMESPACE_TCP
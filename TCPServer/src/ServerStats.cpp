@@ -0,0 +1,152 @@
+#include "ServerStats.h"
+#include <algorithm>
+#include <bit>
+
+BEGIN_NAMESPACE_TCP
+
+// public
+ServerStats::ServerStats(uint32_t numShards)
+    : m_Shards(std::make_unique<ShardCounters[]>(std::max<uint32_t>(numShards, 1)))
+    , m_NumShards(std::max<uint32_t>(numShards, 1))
+    , m_ReadBufferBytes(0)
+    , m_ReadBufferGrowCount(0)
+    , m_ReadBufferShrinkCount(0)
+    , m_MirroredReadBufferFallbacks(0)
+    , m_ReceiveTimestampFallbacks(0)
+    , m_OutboundDroppedMessages(0)
+    , m_OutboundDroppedBytes(0)
+    , m_SlowConsumerDisconnects(0)
+    , m_OutboundConflatedMessages(0)
+    , m_OutboundConflatedBytes(0)
+    , m_ZeroCopyFallbacks(0)
+    , m_ZeroCopyBytes(0)
+    , m_ZeroCopyCompletions(0)
+    , m_ZeroCopyCopiedCompletions(0)
+{
+    for (auto& bucket : m_ReadBufferSizes)
+        bucket.store(0, std::memory_order_relaxed);
+
+    for (uint32_t shard = 0; shard < m_NumShards; ++shard)
+    {
+        ShardCounters& counters = m_Shards[shard];
+        counters.OutboundQueuedBytes.store(0, std::memory_order_relaxed);
+
+        for (std::size_t i = 0; i < NumLatencyBuckets; ++i)
+        {
+            counters.ReceiveQueueingDelays[i].store(0, std::memory_order_relaxed);
+            counters.ReceiveHandlingDelays[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+// public
+void ServerStats::OnReadBufferAllocated(std::size_t size)
+{
+    m_ReadBufferSizes[GetSizeBucket(size)].fetch_add(1, std::memory_order_relaxed);
+    m_ReadBufferBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// public
+void ServerStats::OnReadBufferReleased(std::size_t size)
+{
+    m_ReadBufferSizes[GetSizeBucket(size)].fetch_sub(1, std::memory_order_relaxed);
+    m_ReadBufferBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+// public
+void ServerStats::OnReadBufferResized(std::size_t oldSize, std::size_t newSize)
+{
+    OnReadBufferReleased(oldSize);
+    OnReadBufferAllocated(newSize);
+
+    if (newSize > oldSize)
+        m_ReadBufferGrowCount.fetch_add(1, std::memory_order_relaxed);
+    else
+        m_ReadBufferShrinkCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+// public
+void ServerStats::OnReceiveTimed(uint32_t shardIndex, std::optional<std::chrono::nanoseconds> queueingDelay,
+    std::chrono::nanoseconds handlingDelay)
+{
+    ShardCounters& counters = m_Shards[shardIndex];
+    if (queueingDelay)
+        counters.ReceiveQueueingDelays[GetLatencyBucket(*queueingDelay)].fetch_add(1, std::memory_order_relaxed);
+    counters.ReceiveHandlingDelays[GetLatencyBucket(handlingDelay)].fetch_add(1, std::memory_order_relaxed);
+}
+
+// public
+void ServerStats::OnOutboundDropped(std::size_t numMessages, std::size_t size)
+{
+    m_OutboundDroppedMessages.fetch_add(numMessages, std::memory_order_relaxed);
+    m_OutboundDroppedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// public
+void ServerStats::OnOutboundConflated(std::size_t size)
+{
+    m_OutboundConflatedMessages.fetch_add(1, std::memory_order_relaxed);
+    m_OutboundConflatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+// public
+void ServerStats::OnZeroCopyCompleted(std::size_t numSends, bool isCopied)
+{
+    m_ZeroCopyCompletions.fetch_add(numSends, std::memory_order_relaxed);
+    if (isCopied)
+        m_ZeroCopyCopiedCompletions.fetch_add(numSends, std::memory_order_relaxed);
+}
+
+// public
+ServerStats::SizeHistogram ServerStats::GetReadBufferSizeHistogram() const
+{
+    SizeHistogram histogram;
+    for (std::size_t i = 0; i < NumSizeBuckets; ++i)
+        histogram[i] = m_ReadBufferSizes[i].load(std::memory_order_relaxed);
+
+    return histogram;
+}
+
+// public
+uint64_t ServerStats::GetOutboundQueuedBytes() const
+{
+    uint64_t queuedBytes = 0;
+    for (uint32_t shard = 0; shard < m_NumShards; ++shard)
+        queuedBytes += m_Shards[shard].OutboundQueuedBytes.load(std::memory_order_relaxed);
+
+    return queuedBytes;
+}
+
+// public static
+std::size_t ServerStats::GetSizeBucket(std::size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    return std::min<std::size_t>(std::bit_width(size) - 1, NumSizeBuckets - 1);
+}
+
+// private static
+std::size_t ServerStats::GetLatencyBucket(std::chrono::nanoseconds latency)
+{
+    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    if (microseconds <= 0)
+        return 0;
+
+    return std::min<std::size_t>(std::bit_width(static_cast<uint64_t>(microseconds)) - 1, NumLatencyBuckets - 1);
+}
+
+// private
+ServerStats::LatencyHistogram ServerStats::SumHistogram(ShardHistogram buckets) const
+{
+    LatencyHistogram histogram = {};
+    for (uint32_t shard = 0; shard < m_NumShards; ++shard)
+    {
+        for (std::size_t i = 0; i < NumLatencyBuckets; ++i)
+            histogram[i] += (m_Shards[shard].*buckets)[i].load(std::memory_order_relaxed);
+    }
+
+    return histogram;
+}
+
+END_NAMESPACE_TCP
@@ -0,0 +1,284 @@
+#include "ZeroCopySender.h"
+#include "ServerStats.h"
+#include "TCPCommon/HandlerAllocator.h"
+#include <cstring>
+
+#if defined(__linux__)
+    #include <sys/socket.h>
+    #include <linux/errqueue.h>
+    #include <netinet/in.h>
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    #define NET_HAS_ZEROCOPY
+#endif
+
+BEGIN_NAMESPACE_TCP
+
+#if defined(NET_HAS_ZEROCOPY)
+/* Largest number of buffers handed to a single sendmsg() call. */
+static constexpr std::size_t MaxBuffersPerSend = 64;
+#endif
+
+/* Largest number of emptied batch vectors kept for reuse. */
+static constexpr std::size_t MaxSpareBatches = 8;
+
+// public
+ZeroCopySender::ZeroCopySender(boost::asio::ip::tcp::socket& socket, ServerStats& stats)
+    : m_Socket(socket)
+    , m_Stats(stats)
+    , m_BufferIndex(0)
+    , m_BufferOffset(0)
+    , m_BytesWritten(0)
+    , m_IsInsideAsyncWrite(false)
+    , m_IsWriteUnheld(false)
+    , m_NextID(0)
+    , m_WriteFirstID(0)
+{
+}
+
+// public static
+boost::system::error_code ZeroCopySender::Enable(boost::asio::ip::tcp::socket& socket)
+{
+#if defined(NET_HAS_ZEROCOPY)
+    int enable = 1;
+    if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) != 0)
+        return boost::system::error_code(errno, boost::asio::error::get_system_category());
+
+    // sendmsg() must return EAGAIN instead of blocking the strand, asio keeps its own synchronous calls blocking.
+    boost::system::error_code ec;
+    socket.native_non_blocking(true, ec);
+    return ec;
+#else
+    (void)socket;
+    return boost::asio::error::operation_not_supported;
+#endif
+}
+
+// public
+void ZeroCopySender::AsyncWrite(std::span<const boost::asio::const_buffer> buffers, WriteHandler handler)
+{
+    m_Buffers = buffers;
+    m_BufferIndex = 0;
+    m_BufferOffset = 0;
+    m_BytesWritten = 0;
+    m_Handler = std::move(handler);
+    m_WriteFirstID = m_NextID;
+    m_IsWriteUnheld = true;
+
+    m_IsInsideAsyncWrite = true;
+    SendNext();
+    m_IsInsideAsyncWrite = false;
+}
+
+// private
+void ZeroCopySender::SendNext()
+{
+#if defined(NET_HAS_ZEROCOPY)
+    while (m_BufferIndex < m_Buffers.size())
+    {
+        iovec iov[MaxBuffersPerSend];
+        std::size_t numBuffers = 0;
+
+        for (std::size_t i = m_BufferIndex; i < m_Buffers.size() && numBuffers < MaxBuffersPerSend; ++i, ++numBuffers)
+        {
+            std::size_t offset = i == m_BufferIndex ? m_BufferOffset : 0;
+            iov[numBuffers].iov_base = const_cast<uint8_t*>(static_cast<const uint8_t*>(m_Buffers[i].data())) + offset;
+            iov[numBuffers].iov_len = m_Buffers[i].size() - offset;
+        }
+
+        msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = numBuffers;
+
+        ssize_t bytesSent = sendmsg(m_Socket.native_handle(), &message, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        bool isZeroCopy = true;
+
+        // the pages that a socket may pin are limited, the kernel copies the data instead when the limit is reached.
+        if (bytesSent < 0 && errno == ENOBUFS)
+        {
+            bytesSent = sendmsg(m_Socket.native_handle(), &message, MSG_NOSIGNAL);
+            isZeroCopy = false;
+        }
+
+        if (bytesSent < 0 && errno == EINTR)
+            continue;
+
+        if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            m_Socket.async_wait(boost::asio::socket_base::wait_write,
+                BindRecyclingAllocator([this](const boost::system::error_code& ec)
+                {
+                    if (ec)
+                        Finish(ec);
+                    else
+                        SendNext();
+                }));
+            return;
+        }
+
+        if (bytesSent < 0)
+        {
+            Finish(boost::system::error_code(errno, boost::asio::error::get_system_category()));
+            return;
+        }
+
+        // every call that sends data with MSG_ZEROCOPY takes the next number, the completions refer to it.
+        if (isZeroCopy && bytesSent > 0)
+            ++m_NextID;
+
+        m_BytesWritten += static_cast<std::size_t>(bytesSent);
+        m_Stats.OnZeroCopySent(isZeroCopy ? static_cast<std::size_t>(bytesSent) : 0);
+
+        for (std::size_t remaining = static_cast<std::size_t>(bytesSent); remaining && m_BufferIndex < m_Buffers.size(); )
+        {
+            std::size_t available = m_Buffers[m_BufferIndex].size() - m_BufferOffset;
+            std::size_t consumed = std::min(remaining, available);
+
+            remaining -= consumed;
+            m_BufferOffset += consumed;
+
+            if (m_BufferOffset == m_Buffers[m_BufferIndex].size())
+            {
+                ++m_BufferIndex;
+                m_BufferOffset = 0;
+            }
+        }
+    }
+
+    Finish(boost::system::error_code());
+#else
+    Finish(boost::asio::error::operation_not_supported);
+#endif
+}
+
+// private
+void ZeroCopySender::Finish(const boost::system::error_code& ec)
+{
+    m_Buffers = {};
+
+    WriteHandler handler = std::move(m_Handler);
+    m_Handler = nullptr;
+
+    if (!handler)
+        return;
+
+    // like async_write(), the handler never runs inside the call that started the write, so a handler that starts the
+    // next write does not nest another frame on the stack for every batch.
+    if (m_IsInsideAsyncWrite)
+    {
+        boost::asio::post(m_Socket.get_executor(),
+            BindRecyclingAllocator([handler = std::move(handler), ec, bytesWritten = m_BytesWritten]()
+            {
+                handler(ec, bytesWritten);
+            }));
+        return;
+    }
+
+    handler(ec, m_BytesWritten);
+}
+
+// public
+void ZeroCopySender::HoldUntilCompleted(std::vector<SharedPayload>&& payloads)
+{
+    uint32_t numCalls = m_NextID - m_WriteFirstID;
+    m_WriteFirstID = m_NextID;
+    m_IsWriteUnheld = false;
+
+    // nothing was sent with MSG_ZEROCOPY, e.g. the kernel copied every part because of ENOBUFS.
+    if (numCalls == 0)
+    {
+        RecycleBatch(std::move(payloads));
+        return;
+    }
+
+    m_HeldBatches.push_back({ m_NextID - numCalls, m_NextID - 1, numCalls, std::move(payloads) });
+}
+
+// public
+std::vector<SharedPayload> ZeroCopySender::TakeSpareBatch()
+{
+    if (m_SpareBatches.empty())
+        return {};
+
+    std::vector<SharedPayload> batch = std::move(m_SpareBatches.back());
+    m_SpareBatches.pop_back();
+    return batch;
+}
+
+// public
+void ZeroCopySender::ReapCompletions()
+{
+#if defined(NET_HAS_ZEROCOPY)
+    // the sends of a write that is not held yet may already be completed, they would not find their batch.
+    if (m_IsWriteUnheld)
+        return;
+
+    while (!m_HeldBatches.empty())
+    {
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+
+        msghdr message = {};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        if (recvmsg(m_Socket.native_handle(), &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            return;
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+        {
+            bool isRecvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!isRecvErr)
+                continue;
+
+            sock_extended_err error;
+            memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+
+            if (error.ee_errno == 0 && error.ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+                OnCompleted(error.ee_info, error.ee_data, (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+        }
+    }
+#endif
+}
+
+// private
+void ZeroCopySender::OnCompleted(uint32_t firstID, uint32_t lastID, bool isCopied)
+{
+    m_Stats.OnZeroCopyCompleted(lastID - firstID + 1, isCopied);
+
+    // the numbers wrap around, so they are compared by their distance from the start of the range.
+    uint32_t rangeSize = lastID - firstID;
+    for (HeldBatch& batch : m_HeldBatches)
+    {
+        for (uint32_t id = batch.FirstID; ; ++id)
+        {
+            if (static_cast<uint32_t>(id - firstID) <= rangeSize && batch.NumPending)
+                --batch.NumPending;
+
+            if (id == batch.LastID)
+                break;
+        }
+    }
+
+    std::erase_if(m_HeldBatches, [this](HeldBatch& batch)
+    {
+        if (batch.NumPending)
+            return false;
+
+        RecycleBatch(std::move(batch.Payloads));
+        return true;
+    });
+}
+
+// private
+void ZeroCopySender::RecycleBatch(std::vector<SharedPayload>&& payloads)
+{
+    if (m_SpareBatches.size() >= MaxSpareBatches)
+        return;
+
+    payloads.clear();
+    m_SpareBatches.push_back(std::move(payloads));
+}
+
+END_NAMESPACE_TCP
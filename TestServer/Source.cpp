@@ -21,6 +21,10 @@ public:
     {
         const net::tcp::ClientHandlerSPtr newClientHandle = base::GetClient(newClientID);
 
+        // the client may already be gone again.
+        if (!newClientHandle)
+            return false;
+
         printf("\nClient Connected : %s", newClientHandle->GetInfoString().c_str());
 
         /* Send the ID to the newly connected client. */
@@ -39,22 +43,21 @@ public:
         return true;
     }
 
-    virtual void OnDataReceived(net::tcp::ClientID ID) override
+    virtual void OnDataReceived(net::tcp::ClientHandler& client, std::span<const uint8_t> data) override
     {
-        const net::tcp::ClientHandlerSPtr clientHandle = base::GetClient(ID);
+        const auto& clientInfo = client.GetInfoString();
 
-        const auto& buffer = clientHandle->GetReadBuffer();
-        std::size_t bytesRead = clientHandle->GetBytesRead();
-        const auto& clientInfo = clientHandle->GetInfoString();
-
-        std::string data(buffer.begin(), buffer.begin() + bytesRead);
-        printf("\nFrom %s : %s", clientInfo.c_str(), data.c_str());
+        printf("\nFrom %s : %.*s", clientInfo.c_str(), static_cast<int>(data.size()), reinterpret_cast<const char*>(data.data()));
     }
 
     virtual void OnClientDisconnected(net::tcp::ClientID ID) override
     {
         const net::tcp::ClientHandlerSPtr clientHandle = base::GetClient(ID);
 
+        // the disconnection of this client was already reported.
+        if (!clientHandle)
+            return;
+
         const auto& clientInfo = clientHandle->GetInfoString();
 
         printf("\n%s Disconnected...", clientInfo.c_str());